@@ -25,6 +25,7 @@ extern const sli_bt_gattdb_t gattdb;
 #define gattdb_subevent_id                    29
 #define gattdb_wall_clock_time                31
 #define gattdb_clock_correction               33
+#define gattdb_provisioning                   35
 
 
 #endif // __GATT_DB_H
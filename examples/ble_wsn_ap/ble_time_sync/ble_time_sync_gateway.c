@@ -8,22 +8,135 @@
 #include "app_assert.h"
 #include "ble_time_sync.h"
 #include "ble_time_sync_config.h"
+#include "nvm3_default.h"
 #include <stdbool.h>
+#include <string.h>
+#if PAWR_RADIO_TIMESTAMP
+#include "em_prs.h"
+#include "peripheral_sysrtc.h"
+#endif
+
+// Configuration files of the earlier releases set the interval in seconds
+#if !defined(PAWR_INTERVAL_MS) && defined(PAWR_INTERVAL)
+#define PAWR_INTERVAL_MS                ((PAWR_INTERVAL) * 1000)
+#endif
+
+#if MAX_NUM_PERIPHERAL_NODES > 254
+#error "At most 254 peripheral nodes are supported, node ID 255 is reserved"
+#endif
+#if PAWR_MAX_SYNC_LOST + PAWR_RESYNC_INTERVALS >= PAWR_NODE_TIMEOUT_INTERVALS
+#error "A node looking for the train again has to be kept longer, raise PAWR_NODE_TIMEOUT_INTERVALS"
+#endif
 
 
-#define PAWR_NUM_SUBEVENTS              0x01U
-#define PAWR_PACKET_SIZE                0x02U
 #define PAWR_OPTION_FLAGS               0x00U
 #define PAWR_SUBEVENT_INTERVAL          0xFFU
 #define PAWR_RESPONSE_SLOT_DELAY        0x50U
 #define PAWR_RESPONSE_SLOT_SPACING      0x10U
+// Extended advertising interval of the PAwR set in 0.625 ms units, it carries
+// the SyncInfo the nodes find the train through after a sync loss
+#define PAWR_SYNC_INFO_INTERVAL         1600U
 #define PAST_CONN_INTERVAL_MAX          0x0C80
 #define PAST_CONN_INTERVAL_MIN          0x0006
 #define PAST_CONN_DEFAULT_TIMEOUT       1000
 #define PAST_CONN_MAX_TIMEOUT           0x0C80
 #define PAST_CONN_MIN_TIMEOUT           0x000A
-#define SUBEVENT_ID                     0U
 #define SL_SLEEPTIMER_WALLCLOCK_CONFIG  0xFFU
+// Weight of a new beacon error reported by a node is 1/4
+#define SYNC_ERROR_FILTER_DIVISOR       4
+// Round trips longer than the shortest one by more than its fraction missed a
+// connection event
+#define ROUND_TRIP_MARGIN_DIVISOR       4
+#define PAWR_NUM_RESPONSE_SLOTS         ((MAX_NUM_PERIPHERAL_NODES + PAWR_NUM_SUBEVENTS - 1) / PAWR_NUM_SUBEVENTS)
+// Subevent timing is tracked in 1/16 ticks, each new measurement has a 1/8 weight
+#define SUBEVENT_TIMING_FRACTION_BITS   4
+#define SUBEVENT_TIMING_FILTER_DIVISOR  8
+// A data request further than this from the predicted one restarts the tracking
+#define SUBEVENT_TIMING_MAX_ERROR_US    5000U
+// The capture is armed this long before the transmission the last capture
+// predicts and closed this long after it, so a connection event right after
+// the subevent does not replace it. After this many windows in a row without
+// a capture the transmission is looked for again.
+#define RADIO_TIMESTAMP_EARLY_US        500U
+#define RADIO_TIMESTAMP_LATE_US         100U
+#define RADIO_TIMESTAMP_MAX_MISSES      4U
+// Largest subevent payload the advertiser accepts
+#define PAWR_SUBEVENT_MAX_DATA          251
+// Connection handles run from 1 to SL_BT_CONFIG_MAX_CONNECTIONS
+#define CONNECTION_SLOT_MAP_SIZE        (SL_BT_CONFIG_MAX_CONNECTIONS + 1)
+#define MAX_ACTIVE_CONNECTIONS          (SL_BT_CONFIG_MAX_CONNECTIONS < MAX_NUM_PERIPHERAL_NODES ? \
+                                         SL_BT_CONFIG_MAX_CONNECTIONS : MAX_NUM_PERIPHERAL_NODES)
+
+
+// Node found by the scanner, waiting for a free connection
+typedef struct connection_candidate_t {
+  bd_addr   address;
+  uint8_t   address_type;
+  uint32_t  last_seen;
+} connection_candidate_t;
+
+typedef enum {
+  advertiser_accepted,
+  advertiser_rejected
+} advertiser_verdict_t;
+
+// Classification of a recently seen advertiser
+typedef struct advertiser_cache_entry_t {
+  bd_addr   address;
+  uint8_t   verdict;
+  bool      valid;
+  uint32_t  expires;
+} advertiser_cache_entry_t;
+
+// Timing of the data requests and transmissions of a subevent, the requests
+// come periodically, so their event latency is filtered out
+typedef struct subevent_timing_t {
+  int64_t   request;          // filtered time of the last data request
+  int32_t   lead;             // data request to transmission
+  uint32_t  train_event;      // PAwR intervals since the tracking started
+  uint8_t   multiplier;       // the subevent is sent every multiplier intervals
+  bool      tracked;
+  bool      lead_measured;
+  bool      lead_radio;       // measured at the radio, the arrivals are not used
+  bool      radio_tracked;    // the last capture predicts the next transmission
+  bool      radio_armed;      // a capture window is pending for the responses
+  bool      radio_captured;   // the window took radio_capture
+  uint8_t   radio_misses;     // windows in a row without capture
+  uint32_t  radio_event;      // train_event of the last capture
+  uint64_t  radio_tick;       // transmission of the last capture
+  uint64_t  radio_open;       // capture window armed for the transmission
+  uint64_t  radio_close;
+  uint64_t  radio_capture;
+  sl_sleeptimer_timer_handle_t radio_timer;
+} subevent_timing_t;
+
+// Command waiting for its node in the downlink queue
+typedef struct downlink_command_t {
+  uint8_t   node_id;
+  uint8_t   seq;
+  uint8_t   opcode;
+  uint8_t   len;
+  uint8_t   data[PAWR_COMMAND_MAX_PAYLOAD];
+  uint8_t   attempts;         // PAwR intervals the command was sent in
+  uint32_t  expires;          // end of the repetition of a broadcast command
+} downlink_command_t;
+
+// Provisioning parameters and GATT handles of a known node
+typedef struct rejoin_cache_entry_t {
+  bd_addr   address;
+  uint8_t   id;
+  uint8_t   subevent_id;
+  uint8_t   response_slot;
+  uint32_t  last_used;
+  uint32_t  pawr_configuration_service_handle;
+  uint16_t  peripheral_node_id_characteristic_handle;
+  uint16_t  subevent_id_characteristic_handle;
+  uint16_t  wall_clock_time_characteristic_handle;
+  uint16_t  clock_correction_characteristic_handle;
+  uint16_t  provisioning_characteristic_handle;
+  uint32_t  app_service_handles[MAX_NUM_APP_SERVICES];
+  uint16_t  app_characteristic_handles[MAX_NUM_APP_SERVICES][MAX_NUM_APP_CHARACTERISTICS];
+} rejoin_cache_entry_t;
 
 
 // Peripheral node "PAwR Configuration" service UUID
@@ -36,53 +149,261 @@ static const uint8_t pawr_peripheral_node_id_characteristic_uuid[2] = { 0x0BU, 0
 static const uint8_t pawr_wall_clock_time_characteristic_uuid[2]    = { 0x9AU, 0x50U };
 // Peripheral node "Clock Correction" characteristic UUID
 static const uint8_t pawr_clock_correction_characteristic_uuid[2]   = { 0xC6U, 0x9AU };
+// Peripheral node "Provisioning" characteristic UUID
+static const uint8_t pawr_provisioning_characteristic_uuid[2]       = { 0x5EU, 0x3CU };
 // Number of active connections
 static uint8_t active_connections_num = 0U;
-// Peripheral node counter
-static uint8_t peripheral_node_id = 0U;
-// Subevent ID
-static uint8_t subevent_id = 0U;
-// Wall clock time
-static uint32_t wall_clock_time;
-// Offset
-static uint32_t offset;
-// Connection state
-static bt_connection_state_enum connection_state = inactive;
+// Node ID owning each response slot of each subevent
+static uint8_t response_slot_owner[PAWR_NUM_SUBEVENTS][PAWR_NUM_RESPONSE_SLOTS];
+// Number of nodes assigned to each subevent
+static uint8_t subevent_load[PAWR_NUM_SUBEVENTS];
+// Scanner state, the provisioning state of each node is kept in its table entry
+static bt_connection_state_enum scanner_state = inactive;
 static bool ble_time_sync_initialized = false;
-static uint8_t evt_counter = 0U;
 // The advertising set handle allocated from Bluetooth stack.
 static uint8_t advertising_set_handle = 0xFFU;
-static uint8_t connection_handle      = 0xFFU;
+// Connection being established, only one can be pending at a time
+static uint8_t connection_handle      = SL_BT_INVALID_CONNECTION_HANDLE;
+static bd_addr pending_address;
+// Nodes found while all connections were busy, oldest first
+static connection_candidate_t candidate_queue[CANDIDATE_QUEUE_LENGTH];
+static uint8_t candidate_queue_count  = 0U;
+// Recently seen advertisers, indexed by a hash of the address
+static advertiser_cache_entry_t advertiser_cache[ADVERTISER_CACHE_SIZE];
+// Timing of each subevent, in 1/16 ticks
+static subevent_timing_t subevent_timing[PAWR_NUM_SUBEVENTS];
+// Downlink commands, oldest first, each node gets its oldest one per interval
+static downlink_command_t command_queue[PAWR_COMMAND_QUEUE_LENGTH];
+static uint8_t command_queue_count    = 0U;
+static uint8_t broadcast_command_seq  = PAWR_INVALID_COMMAND_SEQ;
+// Runtime parameters, the PAwR interval in 1.25 ms units
+static ble_time_sync_config_t sync_config;
+static uint16_t pawr_interval_units   = 0U;
+// Sync interval in PAwR intervals, the subevents take it over one by one
+static uint8_t sync_interval_multiplier = 1U;
+static uint32_t interval_changed_tick = 0U;
+static uint32_t interval_stable_tick  = 0U;
 
+// Node table indexed by node ID, entries outlive the connections
 static peripheral_node_t peripheral_nodes[MAX_NUM_PERIPHERAL_NODES];
+// Node table index of each connection, indexed by connection handle
+static uint8_t connection_slot_map[CONNECTION_SLOT_MAP_SIZE];
+// RAM copy of the rejoin cache kept in NVM3
+static rejoin_cache_entry_t rejoin_cache[REJOIN_CACHE_SIZE];
+static uint32_t rejoin_cache_use_counter = 0U;
+// Services of the application resolved during onboarding
+static app_service_t app_services[MAX_NUM_APP_SERVICES];
+static uint8_t app_services_num = 0U;
 
 static uint8_t find_service_by_uuid(uint8_t *data, uint8_t len);
 static void num_to_str(uint8_t* num_arr, uint8_t len, char* str);
-static void add_connection(uint8_t connection, uint16_t address);
+static peripheral_node_t *add_connection(uint8_t connection, const bd_addr *address);
+static void load_rejoin_cache();
+static rejoin_cache_entry_t *find_rejoin_cache_entry(const bd_addr *address);
+static void store_rejoin_cache_entry(const peripheral_node_t *node);
+static void invalidate_rejoin_cache_entry(const bd_addr *address);
+static bool restore_from_rejoin_cache(peripheral_node_t *node);
+static void start_service_discovery(peripheral_node_t *node);
+static bool rediscover_stale_handles(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void clear_gatt_handles(peripheral_node_t *node);
+static bool discover_next_app_service(peripheral_node_t *node);
 static void remove_connection(uint8_t connection);
+static void remove_peripheral_node(peripheral_node_t *node);
 static uint8_t find_index_by_connection_handle(uint8_t connection);
+static uint8_t allocate_peripheral_node_id();
+static void reset_peripheral_node(peripheral_node_t *node);
 static void init_sensor_nodes();
+static void update_scanner();
+static bool is_connecting_or_connected(const bd_addr *address);
+static void queue_candidate(const bd_addr *address, uint8_t address_type);
+static void connect_next_candidate();
+static advertiser_cache_entry_t *lookup_advertiser(const bd_addr *address);
+static advertiser_cache_entry_t *cache_advertiser(const bd_addr *address, advertiser_verdict_t verdict,
+                                                  uint32_t timeout_ms);
+static void init_subevent_allocator();
+static uint8_t find_free_response_slot(uint8_t subevent);
+static bool assign_subevent(peripheral_node_t *node, uint8_t subevent);
+static bool allocate_subevent(peripheral_node_t *node);
+static void release_subevent(peripheral_node_t *node);
+static bool reserve_move(peripheral_node_t *node, uint8_t subevent);
+static void finish_move(peripheral_node_t *node);
+static void cancel_move(peripheral_node_t *node);
+static void rebalance_subevents(uint8_t freed_subevent);
+static sl_status_t validate_config(const ble_time_sync_config_t *config);
+static uint32_t us_to_ticks(uint32_t us);
+static uint64_t track_subevent_request(uint8_t subevent);
+static void update_subevent_lead(uint8_t subevent, uint8_t slot);
+#if PAWR_RADIO_TIMESTAMP
+static void radio_timestamp_init();
+static void radio_timestamp_arm(subevent_timing_t *timing, uint64_t tick);
+static void radio_timestamp_open(sl_sleeptimer_timer_handle_t *handle, void *data);
+static void radio_timestamp_close(sl_sleeptimer_timer_handle_t *handle, void *data);
+#endif
+static uint32_t sync_interval_ticks();
+static bool update_subevent_multiplier(uint8_t subevent);
+static void lengthen_sync_interval();
+static void shorten_sync_interval(bool restart);
+static void update_sync_error(peripheral_node_t *node, int8_t error);
+static uint8_t max_skip_factor();
+static uint8_t next_command_seq(uint8_t seq);
+static uint8_t find_command(uint8_t node_id);
+static sl_status_t queue_command(uint8_t node_id, uint8_t opcode, const uint8_t *data, uint8_t len, uint8_t *seq);
+static void complete_command(uint8_t index, sl_status_t status);
+static void flush_commands(uint8_t node_id);
+static bool append_command(uint8_t *data, uint8_t *len, downlink_command_t *command);
+static uint8_t build_subevent_data(uint8_t subevent, uint64_t tick, uint8_t *data);
+static sl_status_t send_timing_sample(peripheral_node_t *node);
+static void abort_provisioning(peripheral_node_t *node, const char *step, sl_status_t status);
+static uint8_t select_round_trips(const peripheral_node_t *node, uint32_t *sum);
 static void gateway_node_bt_boot(sl_bt_msg_t *evt);
 static void gateway_node_bt_legacy_advertisement_report(sl_bt_msg_t *evt);
 static void gateway_node_bt_connection_opened(sl_bt_msg_t *evt);
 static void gateway_node_bt_service(sl_bt_msg_t *evt);
 static void gateway_node_bt_characteristic(sl_bt_msg_t *evt);
-static void gateway_node_bt_discover_service(sl_bt_msg_t *evt);
-static void gateway_node_bt_set_peripheral_node_id(sl_bt_msg_t *evt);
-static void gateway_node_bt_set_subevent_id(sl_bt_msg_t *evt);
-static void gateway_node_bt_set_wall_clock_time(sl_bt_msg_t *evt);
-static void gateway_node_bt_set_clock_correction(sl_bt_msg_t *evt);
-static void gateway_node_bt_sync_process_finished(sl_bt_msg_t *evt);
-static void gateway_node_bt_advertiser_subevent_data_request();
+static void gateway_node_bt_procedure_completed(sl_bt_msg_t *evt);
+static void gateway_node_bt_discover_service(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_discover_characteristics(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_set_peripheral_node_id(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_set_subevent_id(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_set_wall_clock_time(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_set_clock_correction(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_sync_process_finished(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_update_subevent_id(sl_bt_msg_t *evt, peripheral_node_t *node);
+static void gateway_node_bt_advertiser_subevent_data_request(sl_bt_msg_t *evt);
+static void gateway_node_bt_advertiser_response_report(sl_bt_msg_t *evt);
 static void gateway_node_bt_connection_closed(sl_bt_msg_t *evt);
 static sync_opened_cb sync_ready_callback = NULL;
+static uplink_data_cb uplink_data_callback = NULL;
+static command_status_cb command_status_callback = NULL;
 
 
-void ble_time_sync_init(sync_opened_cb callback)
+void ble_time_sync_get_default_config(ble_time_sync_config_t *config)
+{
+  config->max_num_nodes = MAX_NUM_PERIPHERAL_NODES;
+  config->pawr_interval_ms = PAWR_INTERVAL_MS;
+  config->max_interval_multiplier = PAWR_MAX_INTERVAL_MULTIPLIER;
+  config->sync_accuracy_us = PAWR_SYNC_ACCURACY_US;
+  config->interval_stable_intervals = PAWR_INTERVAL_STABLE_INTERVALS;
+}
+
+
+// The registered services are looked up in the same discovery pass as the
+// PAwR Configuration service, their handles are in the node table entry by
+// the time the callback is called. Without a config the defaults of
+// ble_time_sync_config.h are taken, an invalid one leaves the library
+// uninitialized.
+sl_status_t ble_time_sync_init_with_config(sync_opened_cb callback, const app_service_t *services,
+                                           uint8_t num_services, const ble_time_sync_config_t *config)
 {
+  sl_status_t sc;
+  if (config == NULL) {
+    ble_time_sync_get_default_config(&sync_config);
+  } else {
+    sync_config = *config;
+  }
+  sc = validate_config(&sync_config);
+  if (sc != SL_STATUS_OK) {
+    app_log_error("Invalid BLE Time Sync configuration" APP_LOG_NL);
+    return sc;
+  }
+  pawr_interval_units = (uint16_t)(sync_config.pawr_interval_ms * 8U / 10U);
+  app_assert(num_services <= MAX_NUM_APP_SERVICES, "Too many application services!" APP_LOG_NL);
+  for (uint8_t i = 0; i < num_services; i++) {
+    app_assert(services[i].num_characteristics <= MAX_NUM_APP_CHARACTERISTICS,
+               "Too many application characteristics!" APP_LOG_NL);
+    app_services[i] = services[i];
+  }
+  app_services_num = num_services;
   init_sensor_nodes();
   sync_ready_callback = callback;
   ble_time_sync_initialized = true;
+  return SL_STATUS_OK;
+}
+
+
+// Entry point of the earlier releases: the defaults of ble_time_sync_config.h,
+// no application services
+void ble_time_sync_init(sync_opened_cb callback)
+{
+  ble_time_sync_config_t config;
+  ble_time_sync_get_default_config(&config);
+  sl_status_t sc = ble_time_sync_init_with_config(callback, NULL, 0, &config);
+  app_assert_status(sc);
+}
+
+
+// The node count is bounded by the node table, the PAwR interval has to hold
+// every subevent and the reported beacon errors reach about 3.9 ms only
+static sl_status_t validate_config(const ble_time_sync_config_t *config)
+{
+  uint32_t pawr_interval = (uint32_t)config->pawr_interval_ms * 8U / 10U;
+  if (config->max_num_nodes == 0U || config->max_num_nodes > MAX_NUM_PERIPHERAL_NODES
+      || ((uint32_t)config->pawr_interval_ms * 8U) % 10U != 0U
+      || pawr_interval < (uint32_t)PAWR_NUM_SUBEVENTS * PAWR_SUBEVENT_INTERVAL
+      || config->max_interval_multiplier == 0U
+      || (config->max_interval_multiplier & (config->max_interval_multiplier - 1U)) != 0U
+      || config->sync_accuracy_us == 0U || us_to_ticks(config->sync_accuracy_us) >= INT8_MAX
+      || config->interval_stable_intervals == 0U) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  return SL_STATUS_OK;
+}
+
+
+void ble_time_sync_set_uplink_callback(uplink_data_cb callback)
+{
+  uplink_data_callback = callback;
+}
+
+
+// Queue a command for a node or, with PAWR_BROADCAST_NODE_ID, for every node.
+// It goes out in the subevent of the node until the node acknowledges it,
+// a broadcast command is repeated for PAWR_COMMAND_BROADCAST_INTERVALS.
+sl_status_t ble_time_sync_send_command(uint8_t node_id, uint8_t opcode, const uint8_t *data, uint8_t len, uint8_t *seq)
+{
+  if (opcode == PAWR_COMMAND_MOVE_SUBEVENT) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  return queue_command(node_id, opcode, data, len, seq);
+}
+
+
+// The library queues its own commands alongside those of the application
+static sl_status_t queue_command(uint8_t node_id, uint8_t opcode, const uint8_t *data, uint8_t len, uint8_t *seq)
+{
+  if (len > PAWR_COMMAND_MAX_PAYLOAD
+      || (node_id != PAWR_BROADCAST_NODE_ID
+          && (node_id >= sync_config.max_num_nodes || peripheral_nodes[node_id].id == INVALID_NODE_ID))) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (command_queue_count == PAWR_COMMAND_QUEUE_LENGTH) {
+    return SL_STATUS_FULL;
+  }
+  downlink_command_t *command = &command_queue[command_queue_count++];
+  command->node_id = node_id;
+  if (node_id == PAWR_BROADCAST_NODE_ID) {
+    broadcast_command_seq = next_command_seq(broadcast_command_seq);
+    command->seq = broadcast_command_seq;
+  } else {
+    peripheral_nodes[node_id].command_seq = next_command_seq(peripheral_nodes[node_id].command_seq);
+    command->seq = peripheral_nodes[node_id].command_seq;
+  }
+  command->opcode = opcode;
+  command->len = len;
+  if (len > 0U) {
+    memcpy(command->data, data, len);
+  }
+  command->attempts = 0U;
+  if (seq != NULL) {
+    *seq = command->seq;
+  }
+  return SL_STATUS_OK;
+}
+
+
+void ble_time_sync_set_command_callback(command_status_cb callback)
+{
+  command_status_callback = callback;
 }
 
 
@@ -108,16 +429,22 @@ static uint8_t find_service_by_uuid(uint8_t *data, uint8_t len)
 {
   uint8_t ad_field_length;
   uint8_t ad_field_type;
-  uint8_t i = 0;
+  uint16_t i = 0;
   // Parse advertisement packet
-  while (i < len) {
+  while (i + 1U < len) {
     ad_field_length = data[i];
     ad_field_type = data[i + 1];
+    // a zero length field terminates the data, a truncated one is ignored
+    if (ad_field_length == 0 || i + ad_field_length >= len) {
+      break;
+    }
     // Partial ($02) or complete ($03) list of 16-bit UUIDs
     if (ad_field_type == 0x02 || ad_field_type == 0x03) {
-      // compare UUID to Health Thermometer service UUID
-      if (memcmp(&data[i + 2], pawr_configuration_service_uuid, 2) == 0) {
-        return 1;
+      // compare every UUID of the list to the PAwR Configuration service UUID
+      for (uint16_t j = i + 2U; j + 1U <= i + ad_field_length; j += 2U) {
+        if (memcmp(&data[j], pawr_configuration_service_uuid, 2) == 0) {
+          return 1;
+        }
       }
     }
     // advance to the next AD struct
@@ -127,65 +454,912 @@ static uint8_t find_service_by_uuid(uint8_t *data, uint8_t len)
 }
 
 
+static void reset_peripheral_node(peripheral_node_t *node)
+{
+  node->id = INVALID_NODE_ID;
+  node->connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
+  node->state = inactive;
+  node->subevent_id = INVALID_NODE_ID;
+  node->response_slot = INVALID_RESPONSE_SLOT;
+  node->move_subevent_id = INVALID_NODE_ID;
+  node->move_response_slot = INVALID_RESPONSE_SLOT;
+  node->missed_responses = 0U;
+  clear_gatt_handles(node);
+  memset(&node->address, 0, sizeof(node->address));
+  node->is_synchronized = false;
+  node->rejoined = false;
+  node->command_seq = PAWR_INVALID_COMMAND_SEQ;
+  node->sync_error = 0;
+  node->skip_factor = 1U;
+}
+
+
+static void clear_gatt_handles(peripheral_node_t *node)
+{
+  node->pawr_configuration_service_handle = INVALID_NODE_SERV_HANDLE;
+  node->peripheral_node_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
+  node->subevent_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
+  node->wall_clock_time_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
+  node->clock_correction_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
+  node->provisioning_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
+  node->discovery_index = 0U;
+  for (uint8_t i = 0; i < MAX_NUM_APP_SERVICES; i++) {
+    node->app_service_handles[i] = INVALID_NODE_SERV_HANDLE;
+    for (uint8_t j = 0; j < MAX_NUM_APP_CHARACTERISTICS; j++) {
+      node->app_characteristic_handles[i][j] = INVALID_NODE_CHAR_HANDLE;
+    }
+  }
+}
+
+
 static void init_sensor_nodes() {
   for (int i = 0; i < (int)MAX_NUM_PERIPHERAL_NODES; i++) {
-      peripheral_nodes[i].pawr_configuration_service_handle = INVALID_NODE_SERV_HANDLE;
-      peripheral_nodes[i].peripheral_node_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].subevent_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].wall_clock_time_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].clock_correction_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
-      peripheral_nodes[i].is_synchronized = false;
+      reset_peripheral_node(&peripheral_nodes[i]);
   }
+  memset(connection_slot_map, INVALID_TABLE_INDEX, sizeof(connection_slot_map));
+  active_connections_num = 0U;
+  candidate_queue_count = 0U;
+  memset(advertiser_cache, 0, sizeof(advertiser_cache));
+  for (uint8_t i = 0; i < PAWR_NUM_SUBEVENTS; i++) {
+    (void)sl_sleeptimer_stop_timer(&subevent_timing[i].radio_timer);
+  }
+  memset(subevent_timing, 0, sizeof(subevent_timing));
+  for (uint8_t i = 0; i < PAWR_NUM_SUBEVENTS; i++) {
+    subevent_timing[i].multiplier = 1U;
+  }
+  sync_interval_multiplier = 1U;
+  command_queue_count = 0U;
+  init_subevent_allocator();
+  load_rejoin_cache();
   app_log("Peripheral nodes initialized!" APP_LOG_NL);
 }
 
-// Add a new connection to the connection_properties array
-static void add_connection(uint8_t connection, uint16_t address)
+
+static void init_subevent_allocator()
+{
+  memset(response_slot_owner, INVALID_NODE_ID, sizeof(response_slot_owner));
+  memset(subevent_load, 0, sizeof(subevent_load));
+}
+
+static uint8_t find_free_response_slot(uint8_t subevent)
+{
+  for (uint8_t slot = 0; slot < PAWR_NUM_RESPONSE_SLOTS; slot++) {
+    if (response_slot_owner[subevent][slot] == INVALID_NODE_ID) {
+      return slot;
+    }
+  }
+  return INVALID_RESPONSE_SLOT;
+}
+
+// Assign the lowest free response slot of the given subevent to the node
+static bool assign_subevent(peripheral_node_t *node, uint8_t subevent)
+{
+  uint8_t slot = find_free_response_slot(subevent);
+  if (slot == INVALID_RESPONSE_SLOT) {
+    return false;
+  }
+  response_slot_owner[subevent][slot] = node->id;
+  subevent_load[subevent]++;
+  node->subevent_id = subevent;
+  node->response_slot = slot;
+  return true;
+}
+
+// Put the node into the least loaded subevent
+static bool allocate_subevent(peripheral_node_t *node)
+{
+  uint8_t subevent = 0U;
+  for (uint8_t i = 1; i < PAWR_NUM_SUBEVENTS; i++) {
+    if (subevent_load[i] < subevent_load[subevent]) {
+      subevent = i;
+    }
+  }
+  return assign_subevent(node, subevent);
+}
+
+static void release_subevent(peripheral_node_t *node)
+{
+  cancel_move(node);
+  if (node->subevent_id < PAWR_NUM_SUBEVENTS && node->response_slot < PAWR_NUM_RESPONSE_SLOTS) {
+    response_slot_owner[node->subevent_id][node->response_slot] = INVALID_NODE_ID;
+    subevent_load[node->subevent_id]--;
+  }
+  node->subevent_id = INVALID_NODE_ID;
+  node->response_slot = INVALID_RESPONSE_SLOT;
+}
+
+// Hold a response slot of the given subevent for a node being moved. The
+// node keeps its old slot until it confirms the move, so the allocator does
+// not hand out a slot the node may still answer in.
+static bool reserve_move(peripheral_node_t *node, uint8_t subevent)
+{
+  uint8_t slot = find_free_response_slot(subevent);
+  if (slot == INVALID_RESPONSE_SLOT) {
+    return false;
+  }
+  response_slot_owner[subevent][slot] = node->id;
+  subevent_load[subevent]++;
+  node->move_subevent_id = subevent;
+  node->move_response_slot = slot;
+  return true;
+}
+
+// The node answers in its new slot, the old one is free
+static void finish_move(peripheral_node_t *node)
+{
+  if (node->move_subevent_id >= PAWR_NUM_SUBEVENTS) {
+    return;
+  }
+  response_slot_owner[node->subevent_id][node->response_slot] = INVALID_NODE_ID;
+  subevent_load[node->subevent_id]--;
+  node->subevent_id = node->move_subevent_id;
+  node->response_slot = node->move_response_slot;
+  node->move_subevent_id = INVALID_NODE_ID;
+  node->move_response_slot = INVALID_RESPONSE_SLOT;
+  store_rejoin_cache_entry(node);
+  app_log_info("Node id_%d moved to subevent %d" APP_LOG_NL, node->id, node->subevent_id);
+}
+
+// The node did not get the move, it stays where it is
+static void cancel_move(peripheral_node_t *node)
+{
+  if (node->move_subevent_id >= PAWR_NUM_SUBEVENTS) {
+    return;
+  }
+  response_slot_owner[node->move_subevent_id][node->move_response_slot] = INVALID_NODE_ID;
+  subevent_load[node->move_subevent_id]--;
+  node->move_subevent_id = INVALID_NODE_ID;
+  node->move_response_slot = INVALID_RESPONSE_SLOT;
+}
+
+// Move a synchronized node from the busiest subevent into the one that has
+// just lost a node, if the loads differ by more than one. A connected node is
+// told over GATT, a node without connection by a downlink command. The
+// allocator takes the move over once the write completes or the node
+// acknowledges the command.
+static void rebalance_subevents(uint8_t freed_subevent)
+{
+  sl_status_t sc;
+  uint8_t busiest = 0U;
+  uint8_t assignment[2];
+  for (uint8_t i = 1; i < PAWR_NUM_SUBEVENTS; i++) {
+    if (subevent_load[i] > subevent_load[busiest]) {
+      busiest = i;
+    }
+  }
+  if (subevent_load[busiest] <= subevent_load[freed_subevent] + 1U) {
+    return;
+  }
+  for (uint8_t i = 0; i < MAX_NUM_PERIPHERAL_NODES; i++) {
+    peripheral_node_t *node = &peripheral_nodes[i];
+    if (node->subevent_id != busiest || node->state != sync_established
+        || node->move_subevent_id != INVALID_NODE_ID) {
+      continue;
+    }
+    if (!reserve_move(node, freed_subevent)) {
+      return;
+    }
+    assignment[0] = node->move_subevent_id;
+    assignment[1] = node->move_response_slot;
+    if (node->connection_handle == SL_BT_INVALID_CONNECTION_HANDLE) {
+      sc = queue_command(node->id, PAWR_COMMAND_MOVE_SUBEVENT, assignment, sizeof(assignment), NULL);
+    } else {
+      sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                                 node->subevent_id_characteristic_handle,
+                                                 sizeof(assignment),
+                                                 assignment);
+    }
+    if (sc == SL_STATUS_OK) {
+      app_log_info("Moving node id_%d to subevent %d" APP_LOG_NL, node->id, freed_subevent);
+      if (node->connection_handle != SL_BT_INVALID_CONNECTION_HANDLE) {
+        node->state = update_subevent_id;
+      }
+      return;
+    }
+    cancel_move(node);
+    // the downlink queue is full, the loads stay uneven until the next node leaves
+    if (sc == SL_STATUS_FULL) {
+      return;
+    }
+    // a GATT procedure may be in progress on this link, try the next node then
+  }
+}
+
+// Lowest free entry of the node table, the entry index is the node ID
+static uint8_t allocate_peripheral_node_id()
+{
+  for (uint8_t i = 0; i < sync_config.max_num_nodes; i++) {
+    if (peripheral_nodes[i].state == inactive) {
+      return i;
+    }
+  }
+  return INVALID_NODE_ID;
+}
+
+// Add a new connection to the node table, a known node gets its former
+// node ID, subevent and GATT handles back when they are still free
+static peripheral_node_t *add_connection(uint8_t connection, const bd_addr *address)
 {
-  peripheral_nodes[active_connections_num].connection_handle = connection;
-  peripheral_nodes[active_connections_num].device_address    = address;
-  peripheral_nodes[active_connections_num].id = active_connections_num;
+  rejoin_cache_entry_t *entry = find_rejoin_cache_entry(address);
+  uint8_t id;
+  if (connection >= CONNECTION_SLOT_MAP_SIZE) {
+    return NULL;
+  }
+  // the node lost its sync before the gateway noticed, drop the stale entry
+  for (id = 0; id < MAX_NUM_PERIPHERAL_NODES; id++) {
+    if (peripheral_nodes[id].state != inactive
+        && peripheral_nodes[id].connection_handle == SL_BT_INVALID_CONNECTION_HANDLE
+        && memcmp(&peripheral_nodes[id].address, address, sizeof(bd_addr)) == 0) {
+      remove_peripheral_node(&peripheral_nodes[id]);
+    }
+  }
+  if (entry != NULL && entry->id < sync_config.max_num_nodes && peripheral_nodes[entry->id].state == inactive) {
+    id = entry->id;
+  } else {
+    id = allocate_peripheral_node_id();
+  }
+  if (id == INVALID_NODE_ID) {
+    return NULL;
+  }
+  peripheral_node_t *node = &peripheral_nodes[id];
+  connection_slot_map[connection] = id;
+  node->id = id;
+  node->connection_handle = connection;
+  node->address = *address;
+  // Get last two bytes of sender address
+  node->device_address = (uint16_t)(address->addr[1] << 8) + address->addr[0];
+  node->state = discover_service;
+  if (!restore_from_rejoin_cache(node)) {
+    allocate_subevent(node);
+  }
   active_connections_num++;
+  return node;
+}
+
+
+static void load_rejoin_cache()
+{
+  Ecode_t ec;
+  for (uint8_t i = 0; i < REJOIN_CACHE_SIZE; i++) {
+    ec = nvm3_readData(nvm3_defaultHandle, REJOIN_CACHE_NVM3_KEY_BASE + i,
+                       &rejoin_cache[i], sizeof(rejoin_cache[i]));
+    if (ec != ECODE_NVM3_OK) {
+      memset(&rejoin_cache[i], 0, sizeof(rejoin_cache[i]));
+      rejoin_cache[i].id = INVALID_NODE_ID;
+    } else if (rejoin_cache[i].last_used > rejoin_cache_use_counter) {
+      rejoin_cache_use_counter = rejoin_cache[i].last_used;
+    }
+  }
+}
+
+
+static rejoin_cache_entry_t *find_rejoin_cache_entry(const bd_addr *address)
+{
+  for (uint8_t i = 0; i < REJOIN_CACHE_SIZE; i++) {
+    if (rejoin_cache[i].id != INVALID_NODE_ID
+        && memcmp(&rejoin_cache[i].address, address, sizeof(bd_addr)) == 0) {
+      return &rejoin_cache[i];
+    }
+  }
+  return NULL;
+}
+
+// Remember a provisioned node, the least recently used entry is replaced
+// when the cache is full
+static void store_rejoin_cache_entry(const peripheral_node_t *node)
+{
+  Ecode_t ec;
+  rejoin_cache_entry_t *entry = find_rejoin_cache_entry(&node->address);
+  if (entry == NULL) {
+    entry = &rejoin_cache[0];
+    for (uint8_t i = 1; i < REJOIN_CACHE_SIZE && entry->id != INVALID_NODE_ID; i++) {
+      if (rejoin_cache[i].id == INVALID_NODE_ID || rejoin_cache[i].last_used < entry->last_used) {
+        entry = &rejoin_cache[i];
+      }
+    }
+  }
+  entry->address = node->address;
+  entry->id = node->id;
+  entry->subevent_id = node->subevent_id;
+  entry->response_slot = node->response_slot;
+  entry->last_used = ++rejoin_cache_use_counter;
+  entry->pawr_configuration_service_handle = node->pawr_configuration_service_handle;
+  entry->peripheral_node_id_characteristic_handle = node->peripheral_node_id_characteristic_handle;
+  entry->subevent_id_characteristic_handle = node->subevent_id_characteristic_handle;
+  entry->wall_clock_time_characteristic_handle = node->wall_clock_time_characteristic_handle;
+  entry->clock_correction_characteristic_handle = node->clock_correction_characteristic_handle;
+  entry->provisioning_characteristic_handle = node->provisioning_characteristic_handle;
+  memcpy(entry->app_service_handles, node->app_service_handles, sizeof(entry->app_service_handles));
+  memcpy(entry->app_characteristic_handles, node->app_characteristic_handles,
+         sizeof(entry->app_characteristic_handles));
+  ec = nvm3_writeData(nvm3_defaultHandle, REJOIN_CACHE_NVM3_KEY_BASE + (uint32_t)(entry - rejoin_cache),
+                      entry, sizeof(*entry));
+  if (ec != ECODE_NVM3_OK) {
+    app_log_warning("Failed to store node id_%d in NVM3: 0x%lx" APP_LOG_NL, node->id, (unsigned long)ec);
+  }
+}
+
+
+static void invalidate_rejoin_cache_entry(const bd_addr *address)
+{
+  rejoin_cache_entry_t *entry = find_rejoin_cache_entry(address);
+  if (entry != NULL) {
+    entry->id = INVALID_NODE_ID;
+    (void)nvm3_deleteObject(nvm3_defaultHandle, REJOIN_CACHE_NVM3_KEY_BASE + (uint32_t)(entry - rejoin_cache));
+  }
+}
+
+// Take over subevent, response slot and GATT handles of a known node
+static bool restore_from_rejoin_cache(peripheral_node_t *node)
+{
+  rejoin_cache_entry_t *entry = find_rejoin_cache_entry(&node->address);
+  if (entry == NULL) {
+    return false;
+  }
+  if (entry->subevent_id < PAWR_NUM_SUBEVENTS && entry->response_slot < PAWR_NUM_RESPONSE_SLOTS
+      && response_slot_owner[entry->subevent_id][entry->response_slot] == INVALID_NODE_ID) {
+    response_slot_owner[entry->subevent_id][entry->response_slot] = node->id;
+    subevent_load[entry->subevent_id]++;
+    node->subevent_id = entry->subevent_id;
+    node->response_slot = entry->response_slot;
+  } else {
+    allocate_subevent(node);
+  }
+  node->pawr_configuration_service_handle = entry->pawr_configuration_service_handle;
+  node->peripheral_node_id_characteristic_handle = entry->peripheral_node_id_characteristic_handle;
+  node->subevent_id_characteristic_handle = entry->subevent_id_characteristic_handle;
+  node->wall_clock_time_characteristic_handle = entry->wall_clock_time_characteristic_handle;
+  node->clock_correction_characteristic_handle = entry->clock_correction_characteristic_handle;
+  node->provisioning_characteristic_handle = entry->provisioning_characteristic_handle;
+  memcpy(node->app_service_handles, entry->app_service_handles, sizeof(node->app_service_handles));
+  memcpy(node->app_characteristic_handles, entry->app_characteristic_handles,
+         sizeof(node->app_characteristic_handles));
+  node->rejoined = true;
+  return true;
 }
 
-// Remove a connection from the connection_properties array
+// Remove a connection, a node that confirmed its PAwR sync stays in the
+// network without it in connectionless mode
 static void remove_connection(uint8_t connection)
 {
-  uint8_t i;
   uint8_t table_index = find_index_by_connection_handle(connection);
 
-  if (active_connections_num > 0) {
-    active_connections_num--;
+  if (table_index == INVALID_TABLE_INDEX) {
+    return;
   }
-  app_log_info("Connection with id_%d removed" APP_LOG_NL, peripheral_nodes[table_index].id);
-  // Shift entries after the removed connection toward 0 index
-  for (i = table_index; i < active_connections_num; i++) {
-    peripheral_nodes[i] = peripheral_nodes[i + 1];
+  active_connections_num--;
+  connection_slot_map[connection] = INVALID_TABLE_INDEX;
+  peripheral_nodes[table_index].connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
+#if BLE_TIME_SYNC_CONNECTIONLESS
+  if (peripheral_nodes[table_index].state == sync_established) {
+    app_log_info("Node id_%d continues without connection" APP_LOG_NL, peripheral_nodes[table_index].id);
+    return;
   }
-  // Clear the slots we've just removed so no junk values appear
-  for (i = active_connections_num; i < MAX_NUM_PERIPHERAL_NODES; i++) {
-      peripheral_nodes[i].pawr_configuration_service_handle = INVALID_NODE_SERV_HANDLE;
-      peripheral_nodes[i].peripheral_node_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].subevent_id_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].wall_clock_time_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].clock_correction_characteristic_handle = INVALID_NODE_CHAR_HANDLE;
-      peripheral_nodes[i].connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
-      peripheral_nodes[i].is_synchronized = false;
+#endif
+  remove_peripheral_node(&peripheral_nodes[table_index]);
+}
+
+// Drop a node from the network and hand its response slot to another node
+static void remove_peripheral_node(peripheral_node_t *node)
+{
+  uint8_t freed_subevent = node->subevent_id;
+  app_log_info("Node id_%d removed" APP_LOG_NL, node->id);
+  flush_commands(node->id);
+  release_subevent(node);
+  reset_peripheral_node(node);
+  if (freed_subevent < PAWR_NUM_SUBEVENTS) {
+    rebalance_subevents(freed_subevent);
   }
 }
 
-// Find the index of a given connection in the connection_properties array
+// Find the node table index of a given connection
 static uint8_t find_index_by_connection_handle(uint8_t connection)
 {
-  for (uint8_t i = 0; i < active_connections_num; i++) {
-    if (peripheral_nodes[i].connection_handle == connection) {
+  if (connection >= CONNECTION_SLOT_MAP_SIZE) {
+    return INVALID_TABLE_INDEX;
+  }
+  return connection_slot_map[connection];
+}
+
+// Keep scanning while a node ID is free, the nodes found wait in the
+// candidate queue until a connection slot is free, so discovery overlaps
+// with the provisioning of the connected nodes
+static void update_scanner()
+{
+  sl_status_t sc;
+  bool network_full = (allocate_peripheral_node_id() == INVALID_NODE_ID);
+  if (!network_full && scanner_state != scanning) {
+    sc = sl_bt_scanner_set_parameters(sl_bt_scanner_scan_mode_passive, SCANNER_INTERVAL, SCANNER_WINDOW);
+    app_assert_status(sc);
+    sc = sl_bt_scanner_start(sl_bt_scanner_scan_phy_1m, sl_bt_scanner_discover_generic);
+    app_assert_status_f(sc, "Failed to start discovery" APP_LOG_NL);
+    app_log("Start scanning" APP_LOG_NL);
+    scanner_state = scanning;
+  } else if (network_full && scanner_state == scanning) {
+    sc = sl_bt_scanner_stop();
+    app_assert_status(sc);
+    candidate_queue_count = 0U;
+  }
+  if (network_full && scanner_state != sensor_network_full) {
+    app_log_info("Sensor network is full" APP_LOG_NL);
+    scanner_state = sensor_network_full;
+  }
+  connect_next_candidate();
+}
+
+
+static uint8_t hash_address(const bd_addr *address)
+{
+  uint8_t hash = 0U;
+  for (uint8_t i = 0; i < sizeof(address->addr); i++) {
+    hash = (uint8_t)((hash << 1) ^ (hash >> 7) ^ address->addr[i]);
+  }
+  return hash % ADVERTISER_CACHE_SIZE;
+}
+
+// Cached classification of an advertiser, NULL if it has to be parsed again
+static advertiser_cache_entry_t *lookup_advertiser(const bd_addr *address)
+{
+  advertiser_cache_entry_t *entry = &advertiser_cache[hash_address(address)];
+  if (!entry->valid || memcmp(&entry->address, address, sizeof(bd_addr)) != 0) {
+    return NULL;
+  }
+  if ((int32_t)(sl_sleeptimer_get_tick_count() - entry->expires) >= 0) {
+    entry->valid = false;
+    return NULL;
+  }
+  return entry;
+}
+
+// Remember the verdict of an advertiser, a colliding address is evicted
+static advertiser_cache_entry_t *cache_advertiser(const bd_addr *address, advertiser_verdict_t verdict,
+                                                  uint32_t timeout_ms)
+{
+  uint32_t timeout_ticks;
+  advertiser_cache_entry_t *entry = &advertiser_cache[hash_address(address)];
+  sl_sleeptimer_ms32_to_tick(timeout_ms, &timeout_ticks);
+  entry->address = *address;
+  entry->verdict = verdict;
+  entry->valid = true;
+  entry->expires = sl_sleeptimer_get_tick_count() + timeout_ticks;
+  return entry;
+}
+
+
+static uint32_t us_to_ticks(uint32_t us)
+{
+  return (uint32_t)((uint64_t)us * sl_sleeptimer_get_timer_frequency() / 1000000U);
+}
+
+// Follow the periodic data requests of a subevent and return the expected
+// transmission tick of the subevent requested now
+static uint64_t track_subevent_request(uint8_t subevent)
+{
+  subevent_timing_t *timing = &subevent_timing[subevent];
+  int64_t interval = (int64_t)us_to_ticks(pawr_interval_units * 1250U) << SUBEVENT_TIMING_FRACTION_BITS;
+  int64_t measured = (int64_t)(sl_sleeptimer_get_tick_count64() << SUBEVENT_TIMING_FRACTION_BITS);
+  int64_t error;
+  int64_t intervals;
+  if (timing->tracked) {
+    // empty subevents are not requested, several intervals may have passed
+    error = measured - timing->request;
+    intervals = (error + interval / 2) / interval;
+    timing->request += intervals * interval;
+    timing->train_event += (uint32_t)intervals;
+    error = measured - timing->request;
+    if (error > ((int64_t)us_to_ticks(SUBEVENT_TIMING_MAX_ERROR_US) << SUBEVENT_TIMING_FRACTION_BITS)
+        || error < -((int64_t)us_to_ticks(SUBEVENT_TIMING_MAX_ERROR_US) << SUBEVENT_TIMING_FRACTION_BITS)) {
+      timing->tracked = false;
+    }
+  }
+  if (!timing->tracked) {
+    // the nodes may skip events, send every event until the multiplier is taken again
+    timing->request = measured;
+    timing->train_event = 0U;
+    timing->multiplier = 1U;
+    timing->tracked = true;
+    timing->radio_tracked = false;
+  } else {
+    timing->request += (measured - timing->request) / SUBEVENT_TIMING_FILTER_DIVISOR;
+  }
+  return (uint64_t)((timing->request + timing->lead) >> SUBEVENT_TIMING_FRACTION_BITS);
+}
+
+// Whole PAwR intervals in ticks, the rounding of one does not add up
+static uint64_t train_interval_ticks(uint32_t intervals)
+{
+  return (uint64_t)intervals * pawr_interval_units * 1250U * sl_sleeptimer_get_timer_frequency() / 1000000U;
+}
+
+static uint32_t sync_interval_ticks()
+{
+  return us_to_ticks(pawr_interval_units * 1250U) * sync_interval_multiplier;
+}
+
+// A subevent is sent every multiplier PAwR intervals, its nodes skip the
+// events in between. It takes a new multiplier only at an event sent under
+// both the old and the new one, so its nodes do not miss the change.
+static bool update_subevent_multiplier(uint8_t subevent)
+{
+  subevent_timing_t *timing = &subevent_timing[subevent];
+  uint8_t common = (sync_interval_multiplier > timing->multiplier) ? sync_interval_multiplier : timing->multiplier;
+  if (timing->train_event % timing->multiplier != 0U) {
+    return false;
+  }
+  if (timing->train_event % common == 0U) {
+    timing->multiplier = sync_interval_multiplier;
+  }
+  return true;
+}
+
+// The sync interval is doubled once every node kept the accuracy for
+// interval_stable_intervals sync intervals
+static void lengthen_sync_interval()
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  if (sync_interval_multiplier >= sync_config.max_interval_multiplier
+      || (uint32_t)(now - interval_stable_tick) < sync_interval_ticks() * sync_config.interval_stable_intervals) {
+    return;
+  }
+  sync_interval_multiplier *= 2U;
+  interval_changed_tick = now;
+  interval_stable_tick = now;
+  app_log_info("Sync interval lengthened to %d PAwR intervals" APP_LOG_NL, sync_interval_multiplier);
+}
+
+// The sync interval is halved when a node loses the accuracy, at most once
+// per sync interval so the nodes can follow, and set back to the PAwR
+// interval when a new node has to converge
+static void shorten_sync_interval(bool restart)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  interval_stable_tick = now;
+  if (sync_interval_multiplier == 1U) {
+    return;
+  }
+  if (restart) {
+    sync_interval_multiplier = 1U;
+  } else if ((uint32_t)(now - interval_changed_tick) >= sync_interval_ticks()) {
+    sync_interval_multiplier /= 2U;
+  } else {
+    return;
+  }
+  interval_changed_tick = now;
+  app_log_info("Sync interval shortened to %d PAwR intervals" APP_LOG_NL, sync_interval_multiplier);
+}
+
+// The beacon error of a node grows with the drift it could not follow over
+// the sync interval, it is filtered to average out the event latencies
+static void update_sync_error(peripheral_node_t *node, int8_t error)
+{
+  node->sync_error += (error - node->sync_error) / SYNC_ERROR_FILTER_DIVISOR;
+  if (node->sync_error > (int16_t)us_to_ticks(sync_config.sync_accuracy_us)
+      || node->sync_error < -(int16_t)us_to_ticks(sync_config.sync_accuracy_us)) {
+    shorten_sync_interval(false);
+  }
+}
+
+// A broadcast command has to reach the node skipping most subevents
+static uint8_t max_skip_factor()
+{
+  uint8_t factor = 1U;
+  for (uint8_t i = 0; i < sync_config.max_num_nodes; i++) {
+    if (peripheral_nodes[i].id != INVALID_NODE_ID && peripheral_nodes[i].skip_factor > factor) {
+      factor = peripheral_nodes[i].skip_factor;
+    }
+  }
+  return factor;
+}
+
+// Sequence numbers run from 1 to 255, 0 marks a node without command yet
+static uint8_t next_command_seq(uint8_t seq)
+{
+  return (seq == UINT8_MAX) ? 1U : seq + 1U;
+}
+
+// Index of the oldest command of a node in the downlink queue
+static uint8_t find_command(uint8_t node_id)
+{
+  for (uint8_t i = 0; i < command_queue_count; i++) {
+    if (command_queue[i].node_id == node_id) {
       return i;
     }
   }
   return INVALID_TABLE_INDEX;
 }
 
+static void complete_command(uint8_t index, sl_status_t status)
+{
+  downlink_command_t command = command_queue[index];
+  command_queue_count--;
+  memmove(&command_queue[index], &command_queue[index + 1],
+          (command_queue_count - index) * sizeof(command_queue[0]));
+  if (status != SL_STATUS_OK) {
+    app_log_warning("Command %d of node id_%d failed: 0x%04x" APP_LOG_NL,
+                    command.seq, command.node_id, (unsigned int)status);
+  }
+  // the node acknowledges a move in its first answer after it, in either slot
+  if (command.opcode == PAWR_COMMAND_MOVE_SUBEVENT) {
+    if (status == SL_STATUS_OK) {
+      finish_move(&peripheral_nodes[command.node_id]);
+    } else {
+      cancel_move(&peripheral_nodes[command.node_id]);
+    }
+    return;
+  }
+  if (command_status_callback) {
+    command_status_callback(command.node_id, command.seq, status);
+  }
+}
+
+// The commands of a removed node cannot be delivered anymore
+static void flush_commands(uint8_t node_id)
+{
+  uint8_t index;
+  while ((index = find_command(node_id)) != INVALID_TABLE_INDEX) {
+    complete_command(index, SL_STATUS_ABORT);
+  }
+}
+
+static bool append_command(uint8_t *data, uint8_t *len, downlink_command_t *command)
+{
+  pawr_command_header_t header = {
+    .node_id = command->node_id,
+    .seq = command->seq,
+    .opcode = command->opcode,
+    .len = command->len
+  };
+  if (*len + PAWR_COMMAND_HEADER_LENGTH + command->len > PAWR_SUBEVENT_MAX_DATA) {
+    return false;
+  }
+  memcpy(&data[*len], &header, sizeof(header));
+  memcpy(&data[*len + PAWR_COMMAND_HEADER_LENGTH], command->data, command->len);
+  *len += PAWR_COMMAND_HEADER_LENGTH + command->len;
+  command->attempts++;
+  return true;
+}
+
+// The time beacon, the broadcast command being repeated and the oldest
+// command of every synchronized node of the subevent. Commands which do not
+// fit wait for the next interval, as do the ones of a node that cannot hear
+// the train yet, so their attempts start with the sync.
+static uint8_t build_subevent_data(uint8_t subevent, uint64_t tick, uint8_t *data)
+{
+  uint8_t len = sizeof(pawr_time_beacon_t);
+  uint8_t index;
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  pawr_time_beacon_t beacon = {
+    .epoch = (uint8_t)(tick >> 32),
+    .gateway_tick = (uint32_t)tick,
+    .interval_multiplier = subevent_timing[subevent].multiplier
+  };
+  memcpy(data, &beacon, sizeof(beacon));
+  // broadcast commands are sent one after the other, so the nodes can tell
+  // a repetition from the next command
+  while ((index = find_command(PAWR_BROADCAST_NODE_ID)) != INVALID_TABLE_INDEX) {
+    downlink_command_t *command = &command_queue[index];
+    if (command->attempts == 0U) {
+      command->expires = now + sync_interval_ticks() * PAWR_COMMAND_BROADCAST_INTERVALS * max_skip_factor();
+    } else if ((int32_t)(now - command->expires) >= 0) {
+      complete_command(index, SL_STATUS_OK);
+      continue;
+    }
+    append_command(data, &len, command);
+    break;
+  }
+  for (uint8_t slot = 0; slot < PAWR_NUM_RESPONSE_SLOTS; slot++) {
+    uint8_t id = response_slot_owner[subevent][slot];
+    // a node being moved listens to its old subevent until it confirms
+    if (id == INVALID_NODE_ID || peripheral_nodes[id].state != sync_established
+        || peripheral_nodes[id].subevent_id != subevent) {
+      continue;
+    }
+    while ((index = find_command(id)) != INVALID_TABLE_INDEX
+           && command_queue[index].attempts >= PAWR_COMMAND_MAX_ATTEMPTS * peripheral_nodes[id].skip_factor) {
+      complete_command(index, SL_STATUS_TIMEOUT);
+    }
+    if (index != INVALID_TABLE_INDEX && !append_command(data, &len, &command_queue[index])) {
+      break;
+    }
+  }
+  return len;
+}
+
+// A response arrives at a fixed offset from the transmission of its subevent,
+// which tells how far ahead of the transmission the data was requested.
+// The request and the response are delayed alike by the event queue. The
+// transmission captured at the radio replaces the arrival once it is seen,
+// the beacon then leaves out the event latency of the gateway.
+static void update_subevent_lead(uint8_t subevent, uint8_t slot)
+{
+  subevent_timing_t *timing = &subevent_timing[subevent];
+  uint32_t slot_offset = us_to_ticks(PAWR_RESPONSE_SLOT_DELAY * 1250U + slot * PAWR_RESPONSE_SLOT_SPACING * 125U);
+  uint64_t transmission_tick = sl_sleeptimer_get_tick_count64() - slot_offset;
+  bool radio = false;
+#if PAWR_RADIO_TIMESTAMP
+  // the first response of the event takes the capture of its window, a
+  // capture after the transmission the response tells at the latest is a
+  // connection event. Taken where the last capture predicts, that one was
+  // a connection event too.
+  if (timing->radio_armed) {
+    timing->radio_armed = false;
+    if (timing->radio_captured && timing->radio_capture <= transmission_tick) {
+      transmission_tick = timing->radio_capture;
+      radio = true;
+      timing->radio_tracked = true;
+      timing->radio_misses = 0U;
+      timing->radio_event = timing->train_event;
+      timing->radio_tick = transmission_tick;
+    } else if (timing->radio_tracked
+               && (timing->radio_captured || ++timing->radio_misses >= RADIO_TIMESTAMP_MAX_MISSES)) {
+      // the arrivals take over until the transmission is captured again
+      timing->radio_tracked = false;
+      timing->lead_measured = false;
+      timing->lead_radio = false;
+    }
+  }
+#endif
+  if (timing->lead_radio && !radio) {
+    return;
+  }
+  int64_t transmission = (int64_t)(transmission_tick << SUBEVENT_TIMING_FRACTION_BITS);
+  int64_t lead = transmission - timing->request;
+  if (!timing->tracked || lead < 0
+      || lead > ((int64_t)us_to_ticks(PAWR_SUBEVENT_INTERVAL * 1250U) << SUBEVENT_TIMING_FRACTION_BITS)) {
+    return;
+  }
+  if (!timing->lead_measured || (radio && !timing->lead_radio)) {
+    timing->lead = (int32_t)lead;
+    timing->lead_measured = true;
+    timing->lead_radio = radio;
+  } else {
+    timing->lead += ((int32_t)lead - timing->lead) / SUBEVENT_TIMING_FILTER_DIVISOR;
+  }
+}
+
+
+#if PAWR_RADIO_TIMESTAMP
+// The sync word of a transmitted packet latches the sleeptimer counter
+// through PRS, the sleeptimer itself runs on group 0 of the SYSRTC. The
+// capture is enabled only around the transmission of a subevent.
+static void radio_timestamp_init()
+{
+  int channel = PRS_GetFreeChannel(prsTypeAsync);
+  app_assert(channel >= 0, "No free PRS channel for the radio timestamp" APP_LOG_NL);
+  PRS_ConnectSignal((unsigned int)channel, prsTypeAsync, (PRS_Signal_t)PRS_MODEM_SYNCSENT);
+  PRS_ConnectConsumer((unsigned int)channel, prsTypeAsync, prsConsumerSYSRTC0_SRC0);
+  sl_sysrtc_unlock();
+  SYSRTC0->GRP0_CTRL = (SYSRTC0->GRP0_CTRL & ~SYSRTC_GRP0_CTRL_CAP0EN) | SYSRTC_GRP0_CTRL_CAP0EDGE_RISING;
+  sl_sysrtc_lock();
+  sl_sysrtc_clear_group_interrupts(0U, SYSRTC_GRP0_IF_CAP0);
+}
+
+
+// The radio also transmits in the connection events, in between a
+// subevent and its responses at least. The capture is armed from the data
+// request for a window around the expected transmission: the one the last
+// capture predicts over the PAwR intervals since, or the requested one
+// within the tracking error until a capture is taken. Before the first
+// response it is open from the request up to the response slots. The last
+// packet in the window is captured, so it closes soon after the expected
+// transmission.
+static void radio_timestamp_arm(subevent_timing_t *timing, uint64_t tick)
+{
+  uint64_t now = sl_sleeptimer_get_tick_count64();
+  timing->radio_armed = true;
+  timing->radio_captured = false;
+  if (timing->radio_tracked) {
+    tick = timing->radio_tick + train_interval_ticks(timing->train_event - timing->radio_event);
+    timing->radio_open = tick - us_to_ticks(RADIO_TIMESTAMP_EARLY_US);
+    timing->radio_close = tick + us_to_ticks(RADIO_TIMESTAMP_LATE_US);
+  } else if (timing->lead_measured) {
+    timing->radio_open = tick - us_to_ticks(SUBEVENT_TIMING_MAX_ERROR_US) / 2U;
+    timing->radio_close = tick + us_to_ticks(RADIO_TIMESTAMP_EARLY_US);
+  } else {
+    timing->radio_open = now;
+    timing->radio_close = now + us_to_ticks(PAWR_RESPONSE_SLOT_DELAY * 1250U);
+  }
+  (void)sl_sleeptimer_restart_timer(&timing->radio_timer,
+                                    (timing->radio_open > now) ? (uint32_t)(timing->radio_open - now) : 0U,
+                                    radio_timestamp_open, timing, 0, 0);
+}
+
+static void radio_timestamp_open(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  subevent_timing_t *timing = (subevent_timing_t *)data;
+  uint64_t now = sl_sleeptimer_get_tick_count64();
+  sl_sysrtc_clear_group_interrupts(0U, SYSRTC_GRP0_IF_CAP0);
+  sl_sysrtc_unlock();
+  SYSRTC0->GRP0_CTRL |= SYSRTC_GRP0_CTRL_CAP0EN;
+  sl_sysrtc_lock();
+  (void)sl_sleeptimer_restart_timer(handle,
+                                    (timing->radio_close > now) ? (uint32_t)(timing->radio_close - now) : 0U,
+                                    radio_timestamp_close, timing, 0, 0);
+}
+
+static void radio_timestamp_close(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  subevent_timing_t *timing = (subevent_timing_t *)data;
+  sl_sysrtc_unlock();
+  SYSRTC0->GRP0_CTRL &= ~SYSRTC_GRP0_CTRL_CAP0EN;
+  sl_sysrtc_lock();
+  if (!(sl_sysrtc_get_group_interrupts(0U) & SYSRTC_GRP0_IF_CAP0)) {
+    return;
+  }
+  sl_sysrtc_clear_group_interrupts(0U, SYSRTC_GRP0_IF_CAP0);
+  timing->radio_capture = timing->radio_open
+                          + (int32_t)(sl_sysrtc_get_group_capture_channel_value(0U) - (uint32_t)timing->radio_open);
+  timing->radio_captured = true;
+}
+#endif
+
+
+static bool is_connecting_or_connected(const bd_addr *address)
+{
+  if (connection_handle != SL_BT_INVALID_CONNECTION_HANDLE
+      && memcmp(&pending_address, address, sizeof(bd_addr)) == 0) {
+    return true;
+  }
+  for (uint8_t i = 0; i < MAX_NUM_PERIPHERAL_NODES; i++) {
+    if (peripheral_nodes[i].connection_handle != SL_BT_INVALID_CONNECTION_HANDLE
+        && memcmp(&peripheral_nodes[i].address, address, sizeof(bd_addr)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Add a node to the candidate queue, a node already waiting is only
+// marked as seen again
+static void queue_candidate(const bd_addr *address, uint8_t address_type)
+{
+  char ad_addr[12 + 2 + 1];
+  for (uint8_t i = 0; i < candidate_queue_count; i++) {
+    if (memcmp(&candidate_queue[i].address, address, sizeof(bd_addr)) == 0) {
+      candidate_queue[i].last_seen = sl_sleeptimer_get_tick_count();
+      return;
+    }
+  }
+  if (candidate_queue_count == CANDIDATE_QUEUE_LENGTH || is_connecting_or_connected(address)) {
+    return;
+  }
+  candidate_queue[candidate_queue_count].address = *address;
+  candidate_queue[candidate_queue_count].address_type = address_type;
+  candidate_queue[candidate_queue_count].last_seen = sl_sleeptimer_get_tick_count();
+  candidate_queue_count++;
+  num_to_str((uint8_t*)address->addr, 6, ad_addr);
+  app_log_info("Device found: %s" APP_LOG_NL, ad_addr);
+}
+
+// Connect to the oldest waiting node when a connection slot is free, nodes
+// not seen for CANDIDATE_TIMEOUT_MS have stopped advertising and are dropped
+static void connect_next_candidate()
+{
+  sl_status_t sc;
+  uint32_t timeout_ticks;
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  sl_sleeptimer_ms32_to_tick(CANDIDATE_TIMEOUT_MS, &timeout_ticks);
+  while (candidate_queue_count > 0U
+         && connection_handle == SL_BT_INVALID_CONNECTION_HANDLE
+         && active_connections_num < MAX_ACTIVE_CONNECTIONS
+         && allocate_peripheral_node_id() != INVALID_NODE_ID) {
+    connection_candidate_t candidate = candidate_queue[0];
+    candidate_queue_count--;
+    memmove(&candidate_queue[0], &candidate_queue[1], candidate_queue_count * sizeof(candidate_queue[0]));
+    if ((uint32_t)(now - candidate.last_seen) > timeout_ticks || is_connecting_or_connected(&candidate.address)) {
+      continue;
+    }
+    sc = sl_bt_connection_open(candidate.address, candidate.address_type, sl_bt_gap_phy_1m, &connection_handle);
+    if (sc != SL_STATUS_OK) {
+      app_log_warning("Failed to open connection: 0x%04x" APP_LOG_NL, (unsigned int)sc);
+      connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
+      return;
+    }
+    pending_address = candidate.address;
+  }
+}
+
 
 void gateway_node_on_bt_event(sl_bt_msg_t *evt)
 {
@@ -224,32 +1398,17 @@ void gateway_node_on_bt_event(sl_bt_msg_t *evt)
       // This event is generated for various procedure completions, e.g. when a
       // write procedure is completed, or service discovery is completed
       case sl_bt_evt_gatt_procedure_completed_id:
-        switch(connection_state) {
-          case discover_service:
-            gateway_node_bt_discover_service(evt);
-          break;
-          case set_peripheral_node_id:
-            gateway_node_bt_set_peripheral_node_id(evt);
-          break;
-          case set_subevent_id:
-            gateway_node_bt_set_subevent_id(evt);
-          break;
-          case set_wall_clock_time:
-            gateway_node_bt_set_wall_clock_time(evt);
-          break;
-          case set_clock_correction:
-            gateway_node_bt_set_clock_correction(evt);
-          break;
-          case sync_process_finished:
-            gateway_node_bt_sync_process_finished(evt);
-          break;
-          default: break;
-        }
+          gateway_node_bt_procedure_completed(evt);
       break;
 
       // subevent data request periodically
       case sl_bt_evt_pawr_advertiser_subevent_data_request_id:
-          gateway_node_bt_advertiser_subevent_data_request();
+          gateway_node_bt_advertiser_subevent_data_request(evt);
+      break;
+      // -------------------------------
+      // This event is generated when a response is received in a response slot
+      case sl_bt_evt_pawr_advertiser_response_report_id:
+          gateway_node_bt_advertiser_response_report(evt);
       break;
       // -------------------------------
       // This event indicates that a connection was closed.
@@ -277,49 +1436,61 @@ static void gateway_node_bt_boot(sl_bt_msg_t *evt)
     app_assert_status(sc);
 
     // Enable PAwR functionality
-    uint16_t pawr_interval = (uint16_t)(PAWR_INTERVAL * 1000 * 8 / 10);
-    app_assert(pawr_interval > 0x06U, "Invalid PAwR interval:%d (range: 0.0075 - 81.92 s)" APP_LOG_NL, pawr_interval);
+    // the PAwR interval was validated with the configuration
+    uint16_t pawr_interval = pawr_interval_units;
+    // slot delay is in 1.25 ms, slot spacing in 0.125 ms units
+    app_assert(PAWR_RESPONSE_SLOT_DELAY * 10U + PAWR_NUM_RESPONSE_SLOTS * PAWR_RESPONSE_SLOT_SPACING
+               < PAWR_SUBEVENT_INTERVAL * 10U,
+               "%d response slots do not fit into a subevent" APP_LOG_NL, PAWR_NUM_RESPONSE_SLOTS);
     sc = sl_bt_pawr_advertiser_start(advertising_set_handle, pawr_interval,
                                      pawr_interval, PAWR_OPTION_FLAGS,
                                      PAWR_NUM_SUBEVENTS, PAWR_SUBEVENT_INTERVAL,
                                      PAWR_RESPONSE_SLOT_DELAY, PAWR_RESPONSE_SLOT_SPACING,
-                                     MAX_NUM_PERIPHERAL_NODES);
+                                     PAWR_NUM_RESPONSE_SLOTS);
     app_assert_status_f(sc, "Failed to enable PAwR" APP_LOG_NL);
+    // the sync transfer does not need the extended advertising, but a node
+    // that lost the train can only scan for it this way
+    sc = sl_bt_advertiser_set_timing(advertising_set_handle,
+                                     PAWR_SYNC_INFO_INTERVAL,
+                                     PAWR_SYNC_INFO_INTERVAL,
+                                     0, 0);
+    app_assert_status(sc);
+    sc = sl_bt_extended_advertiser_set_data(advertising_set_handle, 0, NULL);
+    app_assert_status(sc);
+    sc = sl_bt_extended_advertiser_start(advertising_set_handle,
+                                         sl_bt_extended_advertiser_non_connectable,
+                                         0);
+    app_assert_status_f(sc, "Failed to start the SyncInfo advertising" APP_LOG_NL);
     app_log("PAwR started!" APP_LOG_NL);
 
-    // Start scanning - looking for thermometer devices
-    sc = sl_bt_scanner_start(sl_bt_scanner_scan_phy_1m, sl_bt_scanner_discover_generic);
-    app_assert_status_f(sc, "Failed to start discovery" APP_LOG_NL);
-    app_log("Start scanning" APP_LOG_NL);
     init_sensor_nodes();
-    connection_state = scanning;
+#if PAWR_RADIO_TIMESTAMP
+    radio_timestamp_init();
+#endif
+    // Start scanning - looking for peripheral nodes
+    scanner_state = inactive;
+    update_scanner();
 }
 
 
 static void gateway_node_bt_legacy_advertisement_report(sl_bt_msg_t *evt)
 {
-    sl_status_t sc;
-    if (evt->data.evt_scanner_legacy_advertisement_report.event_flags
-        == (SL_BT_SCANNER_EVENT_FLAG_CONNECTABLE | SL_BT_SCANNER_EVENT_FLAG_SCANNABLE)) {
-        // If a peripheral node is found...
-        if (find_service_by_uuid(&(evt->data.evt_scanner_legacy_advertisement_report.data.data[0]),
-                                            evt->data.evt_scanner_legacy_advertisement_report.data.len) != 0) {
-            char ad_addr[12 + 2 + 1];
-            app_log("Scanning" APP_LOG_NL);
-            num_to_str(evt->data.evt_scanner_legacy_advertisement_report.address.addr,
-                       6, ad_addr);
-            app_log_info("Device found: %s" APP_LOG_NL, ad_addr);
-            // then stop scanning for a while
-            sc = sl_bt_scanner_stop();
-            app_assert_status(sc);
-            // and connect to that device
-            if (active_connections_num < SL_BT_CONFIG_MAX_CONNECTIONS) {
-            sc = sl_bt_connection_open(evt->data.evt_scanner_legacy_advertisement_report.address,
-                                       evt->data.evt_scanner_legacy_advertisement_report.address_type,
-                                       sl_bt_gap_phy_1m, &connection_handle);
-            app_assert_status(sc);
-        }
-      }
+    sl_bt_evt_scanner_legacy_advertisement_report_t *report = &evt->data.evt_scanner_legacy_advertisement_report;
+    if (report->event_flags != (SL_BT_SCANNER_EVENT_FLAG_CONNECTABLE | SL_BT_SCANNER_EVENT_FLAG_SCANNABLE)) {
+      return;
+    }
+    // parse the advertisement only if the advertiser is not known yet
+    advertiser_cache_entry_t *entry = lookup_advertiser(&report->address);
+    if (entry == NULL) {
+      entry = cache_advertiser(&report->address,
+                               find_service_by_uuid(&report->data.data[0], report->data.len) != 0
+                               ? advertiser_accepted : advertiser_rejected,
+                               ADVERTISER_CACHE_TIMEOUT_MS);
+    }
+    // If a peripheral node is found...
+    if (entry->verdict == advertiser_accepted) {
+      queue_candidate(&report->address, report->address_type);
+      connect_next_candidate();
     }
 }
 
@@ -327,38 +1498,112 @@ static void gateway_node_bt_legacy_advertisement_report(sl_bt_msg_t *evt)
 static void gateway_node_bt_connection_opened(sl_bt_msg_t *evt)
 {
     sl_status_t sc;
-    sc = sl_bt_gatt_discover_primary_services_by_uuid(evt->data.evt_connection_opened.connection,
-                                                      sizeof(pawr_configuration_service_uuid),
-                                                      (const uint8_t*)pawr_configuration_service_uuid);
-    if (sc == SL_STATUS_INVALID_HANDLE) {
-      // Failed to open connection, restart scanning
-      app_log_warning("Primary service discovery failed with invalid handle, dropping client\n");
-      sc = sl_bt_scanner_start(sl_bt_gap_phy_1m, sl_bt_scanner_discover_generic);
-      app_assert_status(sc);
-      connection_state = scanning;
+    uint8_t connection = evt->data.evt_connection_opened.connection;
+    if (connection == connection_handle) {
+      connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
+    }
+    app_log_info("Connection opened!" APP_LOG_NL);
+    // Add connection to the node table
+    peripheral_node_t *node = add_connection(connection, &evt->data.evt_connection_opened.address);
+    if (node == NULL) {
+      app_log_warning("No free node ID, dropping client" APP_LOG_NL);
+      sc = sl_bt_connection_close(connection);
+      if (sc != SL_STATUS_OK) {
+        app_log_warning("Closing connection %d failed: 0x%04x" APP_LOG_NL, connection, (unsigned int)sc);
+      }
+      return;
+    }
+
+    if (node->rejoined) {
+      // known node, its GATT handles are cached
+      app_log_info("Node id_%d rejoined, skipping discovery" APP_LOG_NL, node->id);
+      node->state = set_peripheral_node_id;
+      gateway_node_bt_set_peripheral_node_id(evt, node);
     } else {
-      app_assert_status(sc);
+      start_service_discovery(node);
     }
+    // look for the next node while this one is provisioned
+    update_scanner();
+}
 
-    app_log_info("Connection opened!" APP_LOG_NL);
-    // Get last two bytes of sender address
-    uint16_t addr_value = (uint16_t)(evt->data.evt_connection_opened.address.addr[1] << 8) + evt->data.evt_connection_opened.address.addr[0];
-    // Add connection to the connection_properties array
-    add_connection(evt->data.evt_connection_opened.connection, addr_value);
 
+static void start_service_discovery(peripheral_node_t *node)
+{
+    sl_status_t sc;
+    node->state = discover_service;
+    if (app_services_num > 0U) {
+      // application services are picked from the same service list
+      sc = sl_bt_gatt_discover_primary_services(node->connection_handle);
+    } else {
+      sc = sl_bt_gatt_discover_primary_services_by_uuid(node->connection_handle,
+                                                        sizeof(pawr_configuration_service_uuid),
+                                                        (const uint8_t*)pawr_configuration_service_uuid);
+    }
+    if (sc != SL_STATUS_OK) {
+      abort_provisioning(node, "Primary service discovery", sc);
+      return;
+    }
     app_log_info("GATT database discovering started!" APP_LOG_NL);
-    connection_state = discover_service;
+}
+
+
+// The cached handles are stale, e.g. after a firmware update of the node,
+// if a write to them fails. The node is discovered again, true if so.
+static bool rediscover_stale_handles(sl_bt_msg_t *evt, peripheral_node_t *node)
+{
+    if (!node->rejoined || evt->data.evt_gatt_procedure_completed.result == SL_STATUS_OK) {
+      return false;
+    }
+    app_log_warning("Cached GATT handles of node id_%d are invalid" APP_LOG_NL, node->id);
+    invalidate_rejoin_cache_entry(&node->address);
+    node->rejoined = false;
+    clear_gatt_handles(node);
+    start_service_discovery(node);
+    return true;
+}
+
+
+// A failed procedure drops its own node only, the others go on being
+// provisioned. The closed event backs the advertiser off and frees the
+// subevent and the response slot. The node keeps its table entry until then,
+// so a new connection does not take it over, and the completions still on the
+// way for it are ignored.
+static void abort_provisioning(peripheral_node_t *node, const char *step, sl_status_t status)
+{
+    sl_status_t sc;
+    app_log_warning("%s of node id_%d failed: 0x%04x, dropping client" APP_LOG_NL,
+                    step, node->id, (unsigned int)status);
+    node->state = connection_closing;
+    sc = sl_bt_connection_close(node->connection_handle);
+    if (sc != SL_STATUS_OK) {
+      // the connection is gone already, its closed event is on the way
+      app_log_warning("Closing connection %d failed: 0x%04x" APP_LOG_NL,
+                      node->connection_handle, (unsigned int)sc);
+    }
 }
 
 
 static void gateway_node_bt_service(sl_bt_msg_t *evt)
 {
     uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_service.connection);
-    if (table_index != INVALID_TABLE_INDEX && connection_state == discover_service &&
-        peripheral_nodes[table_index].pawr_configuration_service_handle == INVALID_NODE_SERV_HANDLE) {
+    if (table_index == INVALID_TABLE_INDEX || peripheral_nodes[table_index].state != discover_service
+        || evt->data.evt_gatt_service.uuid.len != sizeof(pawr_configuration_service_uuid)) {
+      return;
+    }
+    peripheral_node_t *node = &peripheral_nodes[table_index];
+    if (memcmp(evt->data.evt_gatt_service.uuid.data, pawr_configuration_service_uuid,
+               sizeof(pawr_configuration_service_uuid)) == 0) {
       // Save service handle for future reference
-        peripheral_nodes[table_index].pawr_configuration_service_handle = evt->data.evt_gatt_service.service;
-        app_log_info("PAwR config service discovered!" APP_LOG_NL);
+      node->pawr_configuration_service_handle = evt->data.evt_gatt_service.service;
+      app_log_info("PAwR config service discovered!" APP_LOG_NL);
+      return;
+    }
+    for (uint8_t i = 0; i < app_services_num; i++) {
+      if (memcmp(evt->data.evt_gatt_service.uuid.data, app_services[i].service_uuid,
+                 sizeof(app_services[i].service_uuid)) == 0) {
+        node->app_service_handles[i] = evt->data.evt_gatt_service.service;
+        app_log_info("Application service %d discovered!" APP_LOG_NL, i);
+      }
     }
 }
 
@@ -366,7 +1611,16 @@ static void gateway_node_bt_service(sl_bt_msg_t *evt)
 static void gateway_node_bt_characteristic(sl_bt_msg_t *evt)
 {
     uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
+    if (table_index != INVALID_TABLE_INDEX && peripheral_nodes[table_index].discovery_index > 0U) {
+      // characteristic of the application service being discovered
+      uint8_t service = peripheral_nodes[table_index].discovery_index - 1U;
+      for (uint8_t i = 0; i < app_services[service].num_characteristics; i++) {
+        if (memcmp(evt->data.evt_gatt_characteristic.uuid.data, app_services[service].characteristic_uuids[i],
+                   sizeof(app_services[service].characteristic_uuids[i])) == 0) {
+          peripheral_nodes[table_index].app_characteristic_handles[service][i] = evt->data.evt_gatt_characteristic.characteristic;
+        }
+      }
+    } else if (table_index != INVALID_TABLE_INDEX) {
       if (memcmp(evt->data.evt_gatt_characteristic.uuid.data, pawr_subevent_id_characteristic_uuid,
                  sizeof(pawr_subevent_id_characteristic_uuid)) == 0) {
         // Save characteristic handle for future reference
@@ -391,173 +1645,473 @@ static void gateway_node_bt_characteristic(sl_bt_msg_t *evt)
         peripheral_nodes[table_index].clock_correction_characteristic_handle = evt->data.evt_gatt_characteristic.characteristic;
         app_log_info("Clock correction characteristic discovered!" APP_LOG_NL);
       }
+      if (memcmp(evt->data.evt_gatt_characteristic.uuid.data, pawr_provisioning_characteristic_uuid,
+                 sizeof(pawr_provisioning_characteristic_uuid)) == 0) {
+        // Save characteristic handle for future reference
+        peripheral_nodes[table_index].provisioning_characteristic_handle = evt->data.evt_gatt_characteristic.characteristic;
+        app_log_info("Provisioning characteristic discovered!" APP_LOG_NL);
+      }
+    }
+}
+
+
+// Advance the provisioning state machine of the node the procedure belongs to
+static void gateway_node_bt_procedure_completed(sl_bt_msg_t *evt)
+{
+    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_procedure_completed.connection);
+    if (table_index == INVALID_TABLE_INDEX) {
+      return;
+    }
+    peripheral_node_t *node = &peripheral_nodes[table_index];
+    switch (node->state) {
+      case discover_service:
+        gateway_node_bt_discover_service(evt, node);
+      break;
+      case discover_characteristics:
+        gateway_node_bt_discover_characteristics(evt, node);
+      break;
+      case set_peripheral_node_id:
+        gateway_node_bt_set_peripheral_node_id(evt, node);
+      break;
+      case set_subevent_id:
+        gateway_node_bt_set_subevent_id(evt, node);
+      break;
+      case set_wall_clock_time:
+        gateway_node_bt_set_wall_clock_time(evt, node);
+      break;
+      case set_clock_correction:
+        gateway_node_bt_set_clock_correction(evt, node);
+      break;
+      case sync_process_finished:
+        gateway_node_bt_sync_process_finished(evt, node);
+      break;
+      case update_subevent_id:
+        gateway_node_bt_update_subevent_id(evt, node);
+      break;
+      default: break;
     }
 }
 
 
-static void gateway_node_bt_discover_service(sl_bt_msg_t *evt)
+static void gateway_node_bt_discover_service(sl_bt_msg_t *evt, peripheral_node_t *node)
 {
     sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
-      if (peripheral_nodes[table_index].pawr_configuration_service_handle != INVALID_NODE_SERV_HANDLE) {
-        // Discover PAwR config characteristics
-        sc = sl_bt_gatt_discover_characteristics(evt->data.evt_gatt_procedure_completed.connection,
-                                                 peripheral_nodes[table_index].pawr_configuration_service_handle);
-        app_assert_status(sc);
-        connection_state = set_peripheral_node_id;
+    if (node->pawr_configuration_service_handle != INVALID_NODE_SERV_HANDLE) {
+      // Discover PAwR config characteristics
+      sc = sl_bt_gatt_discover_characteristics(node->connection_handle,
+                                               node->pawr_configuration_service_handle);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "Characteristic discovery", sc);
+        return;
       }
+      node->discovery_index = 0U;
+      node->state = discover_characteristics;
+    } else {
+      // not a time sync node, free the connection slot for another one
+      abort_provisioning(node, "PAwR config service discovery", SL_STATUS_NOT_FOUND);
+    }
+}
+
+
+// Discover the characteristics of the application services one after the
+// other, provisioning starts once all of them are resolved
+static void gateway_node_bt_discover_characteristics(sl_bt_msg_t *evt, peripheral_node_t *node)
+{
+    if (!discover_next_app_service(node)) {
+      node->state = set_peripheral_node_id;
+      gateway_node_bt_set_peripheral_node_id(evt, node);
     }
 }
 
 
-static void gateway_node_bt_set_peripheral_node_id(sl_bt_msg_t *evt)
+// False once every service is resolved, true while the node waits for a
+// discovery or for its connection to close
+static bool discover_next_app_service(peripheral_node_t *node)
 {
     sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
-      // If characteristic discovery finished
-      if (peripheral_nodes[table_index].peripheral_node_id_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
-      // stop discovering
-      sl_bt_scanner_stop();
-      // set peripheral node id
-      peripheral_node_id = active_connections_num - 1;
-      sc = sl_bt_gatt_write_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                                 peripheral_nodes[table_index].peripheral_node_id_characteristic_handle,
-                                                 sizeof(peripheral_node_id),
-                                                 (const uint8_t*)&peripheral_node_id);
-      app_assert_status(sc);
-      app_log_info("Peripheral node ID sent to the peripheral node" APP_LOG_NL);
-      connection_state = set_subevent_id;
+    while (node->discovery_index < app_services_num) {
+      uint8_t service = node->discovery_index++;
+      if (node->app_service_handles[service] != INVALID_NODE_SERV_HANDLE
+          && app_services[service].num_characteristics > 0U) {
+        sc = sl_bt_gatt_discover_characteristics(node->connection_handle,
+                                                 node->app_service_handles[service]);
+        if (sc != SL_STATUS_OK) {
+          abort_provisioning(node, "Application characteristic discovery", sc);
+        }
+        return true;
       }
     }
+    return false;
 }
 
 
-static void gateway_node_bt_set_subevent_id(sl_bt_msg_t *evt)
+static void gateway_node_bt_set_peripheral_node_id(sl_bt_msg_t *evt, peripheral_node_t *node)
 {
     sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
-
-      // If characteristic discovery finished
-      if (peripheral_nodes[table_index].subevent_id_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
-        // enable indications
-        sc = sl_bt_gatt_write_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                                   peripheral_nodes[table_index].subevent_id_characteristic_handle,
-                                                   sizeof(subevent_id),
-                                                   (const uint8_t*)&subevent_id);
-        app_assert_status(sc);
-        app_log_info("Subevent ID sent to the peripheral node" APP_LOG_NL);
-        connection_state = set_wall_clock_time;
+    // Node ID, subevent and response slot in one write, older peripheral
+    // nodes only have the separate characteristics
+    if (node->provisioning_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
+      provisioning_record_t record = {
+        .node_id = node->id,
+        .subevent_id = node->subevent_id,
+        .response_slot = node->response_slot,
+        .pawr_interval = pawr_interval_units
+      };
+      sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                                 node->provisioning_characteristic_handle,
+                                                 sizeof(record),
+                                                 (const uint8_t*)&record);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "Provisioning write", sc);
+        return;
+      }
+      app_log_info("Provisioning record sent to the peripheral node" APP_LOG_NL);
+      node->state = set_wall_clock_time;
+    } else if (node->peripheral_node_id_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
+      // set peripheral node id
+      sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                                 node->peripheral_node_id_characteristic_handle,
+                                                 sizeof(node->id),
+                                                 (const uint8_t*)&node->id);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "Node ID write", sc);
+        return;
       }
+      app_log_info("Peripheral node ID sent to the peripheral node" APP_LOG_NL);
+      node->state = set_subevent_id;
+    } else {
+      abort_provisioning(node, "Node ID characteristic discovery", SL_STATUS_NOT_FOUND);
     }
 }
 
 
-static void gateway_node_bt_set_wall_clock_time(sl_bt_msg_t *evt)
+static void gateway_node_bt_set_subevent_id(sl_bt_msg_t *evt, peripheral_node_t *node)
 {
     sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
-      // If characteristic discovery finished
-      if (peripheral_nodes[table_index].wall_clock_time_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
-        CORE_ATOMIC_SECTION(
-            wall_clock_time = sl_sleeptimer_get_tick_count();
-        );
-        sc = sl_bt_gatt_write_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                                   peripheral_nodes[table_index].wall_clock_time_characteristic_handle,
-                                                   sizeof(wall_clock_time),
-                                                   (const uint8_t*)&wall_clock_time);
-        app_assert_status(sc);
-        app_log_info("Wall clock time sent to the peripheral node: %ld" APP_LOG_NL, wall_clock_time);
-        connection_state = set_clock_correction;
+    if (rediscover_stale_handles(evt, node)) {
+      return;
+    }
+    sc = evt->data.evt_gatt_procedure_completed.result;
+    if (sc != SL_STATUS_OK) {
+      abort_provisioning(node, "Node ID write", sc);
+      return;
+    }
+    // If characteristic discovery finished
+    if (node->subevent_id_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
+      // the response slot is sent along with the subevent ID
+      uint8_t assignment[2] = { node->subevent_id, node->response_slot };
+      sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                                 node->subevent_id_characteristic_handle,
+                                                 sizeof(assignment),
+                                                 assignment);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "Subevent ID write", sc);
+        return;
       }
+      app_log_info("Subevent ID %d sent to the peripheral node" APP_LOG_NL, node->subevent_id);
+      node->state = set_wall_clock_time;
+    } else {
+      abort_provisioning(node, "Subevent ID characteristic discovery", SL_STATUS_NOT_FOUND);
     }
 }
 
 
-static void gateway_node_bt_set_clock_correction(sl_bt_msg_t *evt)
+static void gateway_node_bt_set_wall_clock_time(sl_bt_msg_t *evt, peripheral_node_t *node)
 {
-    sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
-      // If characteristic discovery finished
-      if (peripheral_nodes[table_index].clock_correction_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
-          CORE_ATOMIC_SECTION(
-              offset = sl_sleeptimer_get_tick_count() - wall_clock_time;
-          );
-          offset = offset % 2 ? offset / 2 + 1 : offset / 2;
-          sc = evt->data.evt_gatt_procedure_completed.result;
-          app_assert_status_f(sc, "GATT write is failed to complete" APP_LOG_NL);
-          sc = sl_bt_gatt_write_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                                     peripheral_nodes[table_index].clock_correction_characteristic_handle,
-                                                     sizeof(offset),
-                                                     (const uint8_t*)&offset);
-          app_assert_status(sc);
-          app_log_info("Clock correction sent to the peripheral node: %ld" APP_LOG_NL, offset);
-          connection_state = sync_process_finished;
+    if (rediscover_stale_handles(evt, node)) {
+      return;
+    }
+    sl_status_t sc = evt->data.evt_gatt_procedure_completed.result;
+    if (sc != SL_STATUS_OK) {
+      abort_provisioning(node, "Provisioning write", sc);
+      return;
+    }
+    // If characteristic discovery finished
+    if (node->wall_clock_time_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
+      node->timing_sample = 0U;
+      sc = send_timing_sample(node);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "Wall clock write", sc);
+        return;
+      }
+      // the node syncs to the train at the next PAwR event while the round
+      // trips go on, it uses the subevents once its clock is set
+      sc = sl_bt_advertiser_past_transfer(node->connection_handle, 0, advertising_set_handle);
+      if (sc != SL_STATUS_OK) {
+        abort_provisioning(node, "PAST", sc);
+        return;
       }
+      app_log_info("PAST info sent!" APP_LOG_NL);
+      node->state = set_clock_correction;
+    } else {
+      abort_provisioning(node, "Wall clock characteristic discovery", SL_STATUS_NOT_FOUND);
     }
 }
 
 
-static void gateway_node_bt_sync_process_finished(sl_bt_msg_t *evt)
+// Starts a round trip of the timing exchange, the peripheral node keeps the
+// clock offset of every round trip until the correction selects some of them
+static sl_status_t send_timing_sample(peripheral_node_t *node)
 {
     sl_status_t sc;
-    uint8_t table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
-    if (table_index != INVALID_TABLE_INDEX) {
+    timing_sample_t record = { .sample = node->timing_sample };
+    CORE_ATOMIC_SECTION(
+        node->wall_clock_time = sl_sleeptimer_get_tick_count();
+    );
+    record.gateway_tick = node->wall_clock_time;
+    sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                               node->wall_clock_time_characteristic_handle,
+                                               sizeof(record),
+                                               (const uint8_t*)&record);
+    if (sc == SL_STATUS_OK) {
+      app_log_debug("Wall clock time %ld sent to the peripheral node, round trip %d" APP_LOG_NL,
+                    node->wall_clock_time, node->timing_sample);
+    }
+    return sc;
+}
+
+
+static void gateway_node_bt_set_clock_correction(sl_bt_msg_t *evt, peripheral_node_t *node)
+{
+    sl_status_t sc;
+    uint32_t round_trip;
+    if (rediscover_stale_handles(evt, node)) {
+      return;
+    }
+    // If characteristic discovery finished
+    if (node->clock_correction_characteristic_handle != INVALID_NODE_CHAR_HANDLE) {
+        CORE_ATOMIC_SECTION(
+            round_trip = sl_sleeptimer_get_tick_count() - node->wall_clock_time;
+        );
         sc = evt->data.evt_gatt_procedure_completed.result;
-        app_assert_status_f(sc, "GATT write is failed to complete" APP_LOG_NL);
-        sc = sl_bt_advertiser_past_transfer(evt->data.evt_gatt_characteristic.connection, 0, advertising_set_handle);
-        app_assert_status_f(sc, "Failed to send PAST info!" APP_LOG_NL);
-        app_log_info("PAST info sent!" APP_LOG_NL);
-        peripheral_nodes[table_index].is_synchronized = true;
-        if (sync_ready_callback) {
-            sync_ready_callback(evt->data.evt_gatt_characteristic.connection);
+        if (sc != SL_STATUS_OK) {
+          abort_provisioning(node, "Wall clock write", sc);
+          return;
         }
-        if (active_connections_num < SL_BT_CONFIG_MAX_CONNECTIONS) {
-          // start scanning again to find new devices
-          sc = sl_bt_scanner_start(sl_bt_scanner_scan_phy_1m,
-                                   sl_bt_scanner_discover_generic);
-          app_assert_status_f(sc, "Failed to start discovery #2" APP_LOG_NL);
-          connection_state = scanning;
-        } else {
-          connection_state = sensor_network_full;
+        node->round_trips[node->timing_sample] = round_trip;
+        if (++node->timing_sample < PAWR_TIMING_SAMPLES) {
+          sc = send_timing_sample(node);
+          if (sc != SL_STATUS_OK) {
+            abort_provisioning(node, "Wall clock write", sc);
+          }
+          return;
         }
+        uint32_t round_trips;
+        timing_correction_t record = { .samples = select_round_trips(node, &round_trips) };
+        record.round_trips = round_trips;
+        sc = sl_bt_gatt_write_characteristic_value(node->connection_handle,
+                                                   node->clock_correction_characteristic_handle,
+                                                   sizeof(record),
+                                                   (const uint8_t*)&record);
+        if (sc != SL_STATUS_OK) {
+          abort_provisioning(node, "Clock correction write", sc);
+          return;
+        }
+        app_log_info("Clock correction sent to the peripheral node: round trips 0x%02x, %ld ticks" APP_LOG_NL,
+                     record.samples, record.round_trips);
+        node->state = sync_process_finished;
+    } else {
+        abort_provisioning(node, "Clock correction characteristic discovery", SL_STATUS_NOT_FOUND);
+    }
+}
+
+
+// A write that missed its connection event comes back at least one connection
+// interval later, its half round trip is no estimate of the one-way delay.
+// The round trips near the shortest one are kept, their durations summed up.
+static uint8_t select_round_trips(const peripheral_node_t *node, uint32_t *sum)
+{
+    uint32_t shortest = UINT32_MAX;
+    uint8_t samples = 0U;
+    for (uint8_t i = 0; i < PAWR_TIMING_SAMPLES; i++) {
+      if (node->round_trips[i] < shortest) {
+        shortest = node->round_trips[i];
+      }
+    }
+    *sum = 0U;
+    for (uint8_t i = 0; i < PAWR_TIMING_SAMPLES; i++) {
+      if (node->round_trips[i] <= shortest + shortest / ROUND_TRIP_MARGIN_DIVISOR) {
+        samples |= 1U << i;
+        *sum += node->round_trips[i];
+      }
+    }
+    return samples;
+}
+
+
+static void gateway_node_bt_sync_process_finished(sl_bt_msg_t *evt, peripheral_node_t *node)
+{
+    sl_status_t sc;
+    if (rediscover_stale_handles(evt, node)) {
+      return;
+    }
+    sc = evt->data.evt_gatt_procedure_completed.result;
+    if (sc != SL_STATUS_OK) {
+      abort_provisioning(node, "Clock correction write", sc);
+      return;
+    }
+    node->is_synchronized = true;
+    node->state = sync_established;
+    node->sync_error = 0;
+    node->skip_factor = 1U;
+    shorten_sync_interval(true);
+    store_rejoin_cache_entry(node);
+    if (sync_ready_callback) {
+        sync_ready_callback(node->connection_handle);
+    }
+}
+
+
+static void gateway_node_bt_update_subevent_id(sl_bt_msg_t *evt, peripheral_node_t *node)
+{
+    if (evt->data.evt_gatt_procedure_completed.result != SL_STATUS_OK) {
+      app_log_warning("Subevent ID update of node id_%d failed" APP_LOG_NL, node->id);
+      cancel_move(node);
+    } else {
+      finish_move(node);
     }
+    node->state = sync_established;
 }
 
 
-static void gateway_node_bt_advertiser_subevent_data_request()
+static void gateway_node_bt_advertiser_subevent_data_request(sl_bt_msg_t *evt)
 {
   sl_status_t sc;
-  sc = sl_bt_pawr_advertiser_set_subevent_data(advertising_set_handle,
-                                               SUBEVENT_ID, 0,
-                                               MAX_NUM_PERIPHERAL_NODES,
-                                               PAWR_PACKET_SIZE, (const uint8_t*)&evt_counter);
-  app_assert_status_f(sc, "Failed to queue subevent data into PAwR train!" APP_LOG_NL);
+  uint8_t data[PAWR_SUBEVENT_MAX_DATA];
+  uint8_t len;
+  uint64_t tick;
+  uint8_t subevent = evt->data.evt_pawr_advertiser_subevent_data_request.subevent_start;
+  uint8_t count = evt->data.evt_pawr_advertiser_subevent_data_request.subevent_data_count;
+  lengthen_sync_interval();
+  for (; count > 0U && subevent < PAWR_NUM_SUBEVENTS; count--, subevent++) {
+    // nobody listens to an empty subevent, leave it silent
+    if (subevent_load[subevent] == 0U) {
+      continue;
+    }
+    // the beacon carries the expected transmission time of the subevent
+    tick = track_subevent_request(subevent);
+    if (!update_subevent_multiplier(subevent)) {
+      continue;
+    }
+#if PAWR_RADIO_TIMESTAMP
+    radio_timestamp_arm(&subevent_timing[subevent], tick);
+#endif
+    // a node without connection is gone once it stops responding
+    for (uint8_t slot = 0; slot < PAWR_NUM_RESPONSE_SLOTS; slot++) {
+      uint8_t id = response_slot_owner[subevent][slot];
+      if (id == INVALID_NODE_ID || peripheral_nodes[id].connection_handle != SL_BT_INVALID_CONNECTION_HANDLE
+          || peripheral_nodes[id].subevent_id != subevent) {
+        continue;
+      }
+      if (++peripheral_nodes[id].missed_responses > PAWR_NODE_TIMEOUT_INTERVALS * peripheral_nodes[id].skip_factor) {
+        app_log_warning("Node id_%d stopped responding" APP_LOG_NL, id);
+        remove_peripheral_node(&peripheral_nodes[id]);
+        update_scanner();
+      }
+    }
+    len = build_subevent_data(subevent, tick, data);
+    sc = sl_bt_pawr_advertiser_set_subevent_data(advertising_set_handle,
+                                                 subevent, 0,
+                                                 PAWR_NUM_RESPONSE_SLOTS,
+                                                 len, data);
+    app_assert_status_f(sc, "Failed to queue subevent data into PAwR train!" APP_LOG_NL);
+  }
+}
+
+
+// Every synchronized node answers in its own response slot, the first answer
+// confirms the sync and the connection is not needed anymore. An answer longer
+// than the node ID, the acknowledged command and the beacon error carries an
+// uplink record: timestamp and payload.
+static void gateway_node_bt_advertiser_response_report(sl_bt_msg_t *evt)
+{
+  uint32_t timestamp;
+  uint8_t index;
+  uint8_t subevent = evt->data.evt_pawr_advertiser_response_report.subevent;
+  uint8_t slot = evt->data.evt_pawr_advertiser_response_report.response_slot;
+  if (evt->data.evt_pawr_advertiser_response_report.data_status != 0U
+      || evt->data.evt_pawr_advertiser_response_report.data.len < PAWR_RESPONSE_LENGTH
+      || subevent >= PAWR_NUM_SUBEVENTS || slot >= PAWR_NUM_RESPONSE_SLOTS) {
+    return;
+  }
+  uint8_t id = response_slot_owner[subevent][slot];
+  if (id == INVALID_NODE_ID || evt->data.evt_pawr_advertiser_response_report.data.data[0] != id) {
+    return;
+  }
+  peripheral_node_t *node = &peripheral_nodes[id];
+  node->missed_responses = 0U;
+  update_subevent_lead(subevent, slot);
+  // the oldest command of the node is the one being sent
+  index = find_command(id);
+  if (index != INVALID_TABLE_INDEX && command_queue[index].attempts > 0U
+      && command_queue[index].seq == evt->data.evt_pawr_advertiser_response_report.data.data[1]) {
+    complete_command(index, SL_STATUS_OK);
+  }
+  update_sync_error(node, (int8_t)evt->data.evt_pawr_advertiser_response_report.data.data[2]);
+  // the node answers every skip factor-th subevent only, it is given as many more
+  node->skip_factor = evt->data.evt_pawr_advertiser_response_report.data.data[3];
+  if (node->skip_factor == 0U || node->skip_factor > PAWR_MAX_SKIP_FACTOR) {
+    node->skip_factor = 1U;
+  }
+#if BLE_TIME_SYNC_CONNECTIONLESS
+  if (node->state == sync_established && node->connection_handle != SL_BT_INVALID_CONNECTION_HANDLE) {
+    sl_status_t sc = sl_bt_connection_close(node->connection_handle);
+    if (sc == SL_STATUS_OK) {
+      app_log_info("Node id_%d confirmed PAwR sync, closing connection" APP_LOG_NL, id);
+    }
+  }
+#endif
+  if (evt->data.evt_pawr_advertiser_response_report.data.len >= PAWR_UPLINK_HEADER_LENGTH
+      && uplink_data_callback) {
+    memcpy(&timestamp, &evt->data.evt_pawr_advertiser_response_report.data.data[PAWR_RESPONSE_LENGTH],
+           sizeof(timestamp));
+    uplink_data_callback(id, timestamp,
+                         &evt->data.evt_pawr_advertiser_response_report.data.data[PAWR_UPLINK_HEADER_LENGTH],
+                         evt->data.evt_pawr_advertiser_response_report.data.len - PAWR_UPLINK_HEADER_LENGTH);
+  }
 }
 
 
 static void gateway_node_bt_connection_closed(sl_bt_msg_t *evt)
 {
-  sl_status_t sc;
+  uint8_t connection = evt->data.evt_connection_closed.connection;
+  // connection attempt failed before it was opened
+  if (connection == connection_handle) {
+    connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
+  }
+  // a node dropping out of provisioning is ignored for a while, so a
+  // failing node does not take the connection slots over and over
+  const peripheral_node_t *node = get_peripheral_node(connection);
+  if (node != NULL && !node->is_synchronized) {
+    cache_advertiser(&node->address, advertiser_rejected, ADVERTISER_BACKOFF_MS);
+  }
   // remove connection from active connections
-  remove_connection(evt->data.evt_connection_closed.connection);
-  if (connection_state != scanning) {
-    // start scanning again to find new devices
-    sc = sl_bt_scanner_start(sl_bt_scanner_scan_phy_1m,
-                             sl_bt_scanner_discover_generic);
-    app_assert_status_f(sc, "Failed to start discovery #3" APP_LOG_NL);
-    connection_state = scanning;
+  remove_connection(connection);
+  if (scanner_state == sensor_network_full) {
+    scanner_state = inactive;
   }
+  // start scanning again to find new devices
+  update_scanner();
 }
 
 
-peripheral_node_t get_current_peripheral_node(uint8_t connection_handle)
+const peripheral_node_t *get_peripheral_node(uint8_t connection_handle)
 {
-    uint8_t node_id = find_index_by_connection_handle(connection_handle);
-    return peripheral_nodes[node_id];
+    uint8_t table_index = find_index_by_connection_handle(connection_handle);
+    if (table_index == INVALID_TABLE_INDEX) {
+      return NULL;
+    }
+    return &peripheral_nodes[table_index];
 }
 
+
+peripheral_node_t get_current_peripheral_node(uint8_t connection_handle)
+{
+    peripheral_node_t node;
+    const peripheral_node_t *current = get_peripheral_node(connection_handle);
+    if (current == NULL) {
+      reset_peripheral_node(&node);
+      return node;
+    }
+    return *current;
+}
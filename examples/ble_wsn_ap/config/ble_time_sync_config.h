@@ -8,7 +8,56 @@
 #ifndef BLE_TIME_SYNC_CONFIG_H_
 #define BLE_TIME_SYNC_CONFIG_H_
 
-#define MAX_NUM_PERIPHERAL_NODES            4
-#define PAWR_INTERVAL                       10
+// Network size, at most 254 nodes (node ID 255 is reserved)
+#define MAX_NUM_PERIPHERAL_NODES            32
+// PAwR train interval in milliseconds (1.25 ms steps), the shortest sync interval
+#define PAWR_INTERVAL_MS                    2500
+// The sync interval is lengthened up to this many train intervals while the
+// nodes keep the accuracy, a power of two (1 keeps the train interval)
+#define PAWR_MAX_INTERVAL_MULTIPLIER        4
+// Filtered sync error reported by a node, in microseconds, above which the
+// sync interval is shortened
+#define PAWR_SYNC_ACCURACY_US               1000
+// Sync intervals every node has to keep the accuracy before it is lengthened
+#define PAWR_INTERVAL_STABLE_INTERVALS      6
+// Number of PAwR subevents the nodes are spread across (1..128), each one
+// gets MAX_NUM_PERIPHERAL_NODES / PAWR_NUM_SUBEVENTS response slots
+#define PAWR_NUM_SUBEVENTS                  4
+// Set to 1 to close the connection once a node confirmed its PAwR sync in its
+// response slot, the node then keeps its subevent and response slot without a
+// link and is moved to another one by a downlink command, which takes one of
+// the PAWR_COMMAND_QUEUE_LENGTH entries. Keep 0 if the application needs the
+// connections (e.g. for streaming).
+#ifndef BLE_TIME_SYNC_CONNECTIONLESS
+#define BLE_TIME_SYNC_CONNECTIONLESS        0
+#endif
+// A node without connection is dropped after this many silent PAwR intervals
+#define PAWR_NODE_TIMEOUT_INTERVALS         6
+// Downlink commands waiting for their node, shared by all nodes
+#define PAWR_COMMAND_QUEUE_LENGTH           16
+// A command is dropped after being sent in this many PAwR intervals
+// without acknowledgement
+#define PAWR_COMMAND_MAX_ATTEMPTS           6
+// PAwR intervals a broadcast command is repeated for, it is not acknowledged
+#define PAWR_COMMAND_BROADCAST_INTERVALS    3
+// Scan interval and window in 0.625 ms units, the scanner keeps running at
+// this duty cycle while the nodes found are provisioned
+#define SCANNER_INTERVAL                    160
+#define SCANNER_WINDOW                      80
+// Number of discovered nodes waiting for a free connection
+#define CANDIDATE_QUEUE_LENGTH              8
+// A waiting node is dropped if it was not seen for this many milliseconds
+#define CANDIDATE_TIMEOUT_MS                1000
+// Advertisers are classified once and remembered in a cache of this size
+#define ADVERTISER_CACHE_SIZE               16
+// Milliseconds an advertiser's classification is reused before its
+// advertisement is parsed again
+#define ADVERTISER_CACHE_TIMEOUT_MS         10000
+// Milliseconds a node that failed provisioning is ignored
+#define ADVERTISER_BACKOFF_MS               5000
+// Number of known nodes remembered in NVM3 for fast rejoin (at least 1)
+#define REJOIN_CACHE_SIZE                   MAX_NUM_PERIPHERAL_NODES
+// First NVM3 key of the rejoin cache, one object per entry
+#define REJOIN_CACHE_NVM3_KEY_BASE          0x0B700U
 
 #endif /* BLE_TIME_SYNC_CONFIG_H_ */
@@ -25,8 +25,9 @@ extern const sli_bt_gattdb_t gattdb;
 #define gattdb_subevent_id                    29
 #define gattdb_wall_clock_time                31
 #define gattdb_clock_correction               33
-#define gattdb_audio_streaming_service        34
-#define gattdb_audio_data                     36
+#define gattdb_provisioning                   35
+#define gattdb_audio_streaming_service        36
+#define gattdb_audio_data                     38
 
 
 #endif // __GATT_DB_H
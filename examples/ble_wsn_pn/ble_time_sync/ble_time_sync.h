@@ -15,54 +15,235 @@
 #define PAWR_SYNC_SKIP                    0x00U
 #define PAWR_SYNC_MAX_TIMEOUT             0x2000U
 #define PAWR_SUBEVENT_LENGTH              1
+#define PAWR_RESPONSE_LENGTH              4
+#define PAWR_UPLINK_HEADER_LENGTH         8
+#define PAWR_UPLINK_MAX_PAYLOAD           32
+#define PAWR_UPLINK_QUEUE_LENGTH          4
+#define PAWR_COMMAND_HEADER_LENGTH        4
+#define PAWR_COMMAND_MAX_PAYLOAD          8
+#define PAWR_BROADCAST_NODE_ID            255
+// Opcode the gateway moves a node without connection to another subevent
+// with, subevent and response slot follow. Reserved for the library.
+#define PAWR_COMMAND_MOVE_SUBEVENT        0xFF
+#define PAWR_INVALID_COMMAND_SEQ          0
 #define PAWR_CLOCK_DRIFT_MULTIPLIER       100
 #define PAWR_MIN_SYNC_TIMEOUT             0x0a
 #define PAWR_MAX_SYNC_TIMEOUT             0x4000
 #define INVALID_AP_ADDRESS                ("\0\0\0\0\0\0")
 #define PAWR_CLOCK_DRIFT_DIVISOR          1000
 #define PAWR_MAX_SYNC_LOST                3
+// Sync intervals a node that lost the train looks for it with the sync
+// scanner before it asks for provisioning again. It keeps its response slot
+// meanwhile, so PAWR_MAX_SYNC_LOST + PAWR_RESYNC_INTERVALS has to stay below
+// PAWR_NODE_TIMEOUT_INTERVALS of the gateway.
+#define PAWR_RESYNC_INTERVALS             2
+// External signal of the resync timeout, not to be used by the application
+#define PAWR_RESYNC_EXT_SIGNAL            0x80000000UL
+// A node whose clock holds the accuracy over longer than the sync interval
+// listens to every skip factor-th subevent only, a power of two up to this
+#define PAWR_MAX_SKIP_FACTOR              8
+#define PAWR_SKIP_ACCURACY_US             250
+// External signal of a subevent not received in time
+#define PAWR_SUBEVENT_EXT_SIGNAL          0x40000000UL
+// Corrections of the clock reach get_timestamp() spread over the slew window,
+// at no more than the slew rate, so the timestamps never go backwards. The
+// slew lasts PAWR_SLEW_MAX_HOLD_MS at most, a longer one forward runs at a
+// higher rate. A correction beyond PAWR_SLEW_MAX_STEP_MS is stepped forward.
+// Backward, beyond the step bound or the slew rate over the hold, the time
+// is held until the clock caught up with it, for at most
+// PAWR_SLEW_MAX_HOLD_MS. The first timing exchange is stepped.
+#define PAWR_SLEW_WINDOW_MS               1000
+#define PAWR_SLEW_MAX_PPM                 500
+#define PAWR_SLEW_MAX_STEP_MS             100
+#define PAWR_SLEW_MAX_HOLD_MS             10000
+// Round trips of the timing exchange, up to 8, the clock offset is averaged
+// over the ones that did not miss a connection event
+#define PAWR_TIMING_SAMPLES               4
 #define PAWR_INTERVAL_RESOLUTION_MS       1.25f
 #define PAWR_INTEGER_INTERVAL             (uint32_t)(PAWR_CLOCK_DRIFT_MULTIPLIER * PAWR_INTERVAL_RESOLUTION_MS)
 #define INVALID_NODE_ID                   255
+// Latch the sleeptimer at the sync word of the subevent through PRS and the
+// SYSRTC capture, instead of reading it when the event is processed
+#define PAWR_RADIO_TIMESTAMP              1
+#define PAWR_ARRIVAL_NOISE_US             600
+#define PAWR_SKEW_NOISE_PPB               20
+#define PAWR_MAX_SKEW_PPM                 200
+#define MAX_NUM_APP_SERVICES              2
+#define MAX_NUM_APP_CHARACTERISTICS       4
+#define INVALID_RESPONSE_SLOT             255
 
 typedef enum {
   inactive,
   scanning,
   discover_service,
+  discover_characteristics,
   set_peripheral_node_id,
   set_subevent_id,
   set_wall_clock_time,
   set_clock_correction,
   sync_process_finished,
+  sync_established,
+  update_subevent_id,
+  connection_closing,
   sensor_network_full
 } bt_connection_state_enum;
 
 typedef struct peripheral_node_t {
   uint8_t        id;
   uint16_t       device_address;
+  bd_addr        address;
   uint8_t        connection_handle;
+  bt_connection_state_enum state;
+  uint8_t        subevent_id;
+  uint8_t        response_slot;
+  uint8_t        move_subevent_id;    // subevent the node is being moved to
+  uint8_t        move_response_slot;  // held for the node until it confirms the move
+  uint8_t        missed_responses;
+  uint32_t       wall_clock_time;
   uint32_t       pawr_configuration_service_handle;
   uint16_t       subevent_id_characteristic_handle;
   uint16_t       wall_clock_time_characteristic_handle;
   uint16_t       clock_correction_characteristic_handle;
   uint16_t       peripheral_node_id_characteristic_handle;
+  uint16_t       provisioning_characteristic_handle;
   bool           is_synchronized;
+  bool           rejoined;
+  uint8_t        discovery_index;
+  uint8_t        command_seq;
+  int16_t        sync_error;      // filtered beacon error reported by the node, in ticks
+  uint8_t        skip_factor;     // the node answers every skip_factor-th subevent
+  uint8_t        timing_sample;   // round trip of the timing exchange in flight
+  uint32_t       round_trips[PAWR_TIMING_SAMPLES];  // of the timing exchange, in ticks
+  // handles of the registered application services, in registration order
+  uint32_t       app_service_handles[MAX_NUM_APP_SERVICES];
+  uint16_t       app_characteristic_handles[MAX_NUM_APP_SERVICES][MAX_NUM_APP_CHARACTERISTICS];
 } peripheral_node_t;
 
+// Application service resolved in the same discovery pass as the
+// PAwR Configuration service, 16-bit UUIDs in little endian order
+typedef struct app_service_t {
+  uint8_t   service_uuid[2];
+  uint8_t   num_characteristics;
+  uint8_t   characteristic_uuids[MAX_NUM_APP_CHARACTERISTICS][2];
+} app_service_t;
+
+// "Provisioning" characteristic value, the node parameters in one write
+PACKSTRUCT(struct provisioning_record_s {
+  uint8_t   node_id;
+  uint8_t   subevent_id;
+  uint8_t   response_slot;
+  uint16_t  pawr_interval;    // in 1.25 ms units
+});
+typedef struct provisioning_record_s provisioning_record_t;
+
+// "Wall Clock Time" value of a round trip of the timing exchange, older
+// gateways send the bare 32-bit tick
+PACKSTRUCT(struct timing_sample_s {
+  uint32_t  gateway_tick;
+  uint8_t   sample;
+});
+typedef struct timing_sample_s timing_sample_t;
+
+// "Clock Correction" value closing the timing exchange, the round trips the
+// offset is averaged over and the sum of their durations. Older gateways send
+// the bare 32-bit one-way delay of the last round trip.
+PACKSTRUCT(struct timing_correction_s {
+  uint32_t  round_trips;      // in ticks
+  uint8_t   samples;          // bit per round trip
+});
+typedef struct timing_correction_s timing_correction_t;
+
+// Subevent payload of the gateway, its sleeptimer tick at the transmission
+// of the subevent, the epoch counts the wraps of the 32-bit tick. The
+// subevent is sent every interval_multiplier PAwR intervals.
+PACKSTRUCT(struct pawr_time_beacon_s {
+  uint8_t   epoch;
+  uint32_t  gateway_tick;
+  uint8_t   interval_multiplier;
+});
+typedef struct pawr_time_beacon_s pawr_time_beacon_t;
+
+// Downlink command following the time beacon in the subevent payload, the
+// node acknowledges the sequence number in the second byte of its response,
+// the third one is its last beacon error in ticks, the fourth its skip factor
+PACKSTRUCT(struct pawr_command_header_s {
+  uint8_t   node_id;          // PAWR_BROADCAST_NODE_ID addresses every node
+  uint8_t   seq;
+  uint8_t   opcode;
+  uint8_t   len;
+});
+typedef struct pawr_command_header_s pawr_command_header_t;
+
+// Runtime parameters of the gateway, the defaults come from ble_time_sync_config.h
+typedef struct ble_time_sync_config_t {
+  uint8_t   max_num_nodes;              // 1..MAX_NUM_PERIPHERAL_NODES
+  uint16_t  pawr_interval_ms;           // PAwR train interval, in 1.25 ms steps
+  uint8_t   max_interval_multiplier;    // longest sync interval, a power of two
+  uint16_t  sync_accuracy_us;           // the sync interval is shortened above it
+  uint8_t   interval_stable_intervals;  // stable sync intervals before lengthening
+} ble_time_sync_config_t;
+
+// Runtime parameters of a peripheral node
+typedef struct peripheral_node_config_t {
+  uint16_t  arrival_noise_us;           // standard deviation of the subevent arrival
+  uint16_t  skew_noise_ppb;             // random walk of the crystal error, per sqrt(s)
+  uint16_t  skip_accuracy_us;           // predicted error up to which subevents are skipped, 0 never
+  uint16_t  slew_window_ms;             // a correction is spread over it at least, 0 steps it forward
+  uint16_t  slew_max_ppm;               // bound of the slew rate
+} peripheral_node_config_t;
+
+// Synchronized clock of a peripheral node, get_timestamp() reads a published
+// copy of it
+typedef struct sync_clock_t {
+  int64_t   offset;                     // synchronized minus local time, 64-bit ticks
+  uint32_t  fraction;                   // sub-tick part of the offset, 2^-32 ticks
+  int32_t   skew;                       // 2^-32 ticks per tick since skew_anchor_tick
+  uint64_t  skew_anchor_tick;
+  int64_t   slew_remaining;             // correction not presented yet at slew_anchor_tick, 2^-32 ticks
+  int64_t   slew_rate;                  // 2^-32 ticks per tick
+  uint32_t  slew_ticks;                 // length of the slew
+  uint64_t  slew_anchor_tick;
+} sync_clock_t;
+
 typedef struct time_sync_handle_t {
   uint8_t   id;
   uint8_t   connection_handle;
   uint8_t   subevent_id;
-  int32_t   clock_offset;
+  uint8_t   response_slot;
+  uint16_t  pawr_interval;
+  sync_clock_t clock;
   uint32_t  pawr_interval_ticks;
   uint16_t  sync_handle;
+  uint8_t   gateway_epoch;
+  uint8_t   interval_multiplier;
+  uint8_t   skip_factor;                // sync intervals between two subevents received
 } time_sync_handle_t;
 
 void gateway_node_on_bt_event(sl_bt_msg_t *bt_evt);
 peripheral_node_t get_current_peripheral_node(uint8_t connection_handle);
+const peripheral_node_t *get_peripheral_node(uint8_t connection_handle);
 typedef void(*sync_opened_cb)(uint8_t connection_handle);
+void ble_time_sync_get_default_config(ble_time_sync_config_t *config);
+sl_status_t ble_time_sync_init_with_config(sync_opened_cb callback, const app_service_t *services,
+                                           uint8_t num_services, const ble_time_sync_config_t *config);
 void ble_time_sync_init(sync_opened_cb callback);
+typedef void(*uplink_data_cb)(uint8_t node_id, uint32_t timestamp, const uint8_t *data, uint8_t len);
+void ble_time_sync_set_uplink_callback(uplink_data_cb callback);
+typedef void(*command_status_cb)(uint8_t node_id, uint8_t seq, sl_status_t status);
+// data may be NULL when len is 0
+sl_status_t ble_time_sync_send_command(uint8_t node_id, uint8_t opcode, const uint8_t *data, uint8_t len, uint8_t *seq);
+void ble_time_sync_set_command_callback(command_status_cb callback);
+sl_status_t peripheral_node_init(const peripheral_node_config_t *config);
 void peripheral_node_on_bt_event(sl_bt_msg_t* evt);
+sl_status_t peripheral_node_send_uplink_data(const uint8_t *data, uint8_t len);
+typedef void(*downlink_command_cb)(uint8_t opcode, const uint8_t *data, uint8_t len);
+void peripheral_node_set_command_callback(downlink_command_cb callback);
+bool peripheral_node_in_holdover();
 uint32_t get_timestamp();
+uint64_t get_timestamp64();
+uint64_t peripheral_node_ticks_to_us(uint64_t ticks);
+uint64_t peripheral_node_ticks_to_ns(uint64_t ticks);
+uint64_t peripheral_node_us_to_ticks(uint64_t us);
+uint64_t peripheral_node_ns_to_ticks(uint64_t ns);
 
 #endif /* BLE_TIME_SYNC_H_ */
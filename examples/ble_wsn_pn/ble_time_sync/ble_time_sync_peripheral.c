@@ -7,35 +7,282 @@
 
 #include "app_assert.h"
 #include "ble_time_sync.h"
+#include "em_core.h"
 #include "gatt_db.h"
 #include "sl_status.h"
+#include <string.h>
+#if PAWR_RADIO_TIMESTAMP
+#include <float.h>
+#include "em_prs.h"
+#include "peripheral_sysrtc.h"
+#endif
+
+// Offset uncertainty of the timing exchange the estimator starts from
+#define CLOCK_INITIAL_OFFSET_US         1000U
+// Innovations beyond this many standard deviations are outliers, after
+// CLOCK_MAX_OUTLIERS in a row the offset is learned again
+#define CLOCK_OUTLIER_SIGMA             4.0f
+#define CLOCK_MAX_OUTLIERS              3U
+// 2^32 / 10^6, a skew in ppm to 2^-32 ticks per tick
+#define CLOCK_SKEW_PPM_SCALE            4294.967296f
+// The beacon carries 8 bits of the gateway epoch above the 32-bit tick
+#define CLOCK_BEACON_TIME_BITS          40U
+// A captured arrival older than this is not the one of the subevent
+#define RADIO_TIMESTAMP_MAX_AGE_US      20000U
+// Least distance from the predicted arrival within which a capture is taken
+// for the subevent
+#define RADIO_TIMESTAMP_WINDOW_US       250U
+
+typedef struct uplink_record_t {
+  uint32_t  timestamp;
+  uint8_t   len;
+  uint8_t   data[PAWR_UPLINK_MAX_PAYLOAD];
+} uplink_record_t;
+
+// value * multiplier / 2^shift, the multiplier uses all of its 32 bits
+typedef struct clock_scale_t {
+  uint32_t  multiplier;
+  uint8_t   shift;
+} clock_scale_t;
+
+// Presented time before a correction of the estimate, the offset and the
+// sub-tick parts are kept apart so that no offset overflows
+typedef struct clock_slew_point_t {
+  uint64_t  tick;
+  int64_t   offset;
+  int64_t   extrapolation;
+  int64_t   pending;
+} clock_slew_point_t;
+
+// Kalman filter of the clock offset and skew, the offset itself lives in
+// time_sync_handle, the covariance is in ticks and ppm
+typedef struct clock_estimator_t {
+  float     skew_ppm;
+  float     p_offset;
+  float     p_cross;
+  float     p_skew;
+  uint8_t   outliers;
+} clock_estimator_t;
 
 static time_sync_handle_t time_sync_handle = {
     .connection_handle = SL_BT_INVALID_CONNECTION_HANDLE,
     .sync_handle = SL_BT_INVALID_SYNC_HANDLE,
     .id = INVALID_NODE_ID,
     .subevent_id = INVALID_NODE_ID,
-    .clock_offset = 0,
-    .pawr_interval_ticks = 0U
+    .response_slot = INVALID_RESPONSE_SLOT,
+    .pawr_interval = 0U,
+    .clock = {
+        .offset = 0,
+        .fraction = 0U,
+        .skew = 0,
+        .skew_anchor_tick = 0ULL,
+        .slew_remaining = 0,
+        .slew_rate = 0,
+        .slew_ticks = 0U,
+        .slew_anchor_tick = 0ULL
+    },
+    .pawr_interval_ticks = 0U,
+    .gateway_epoch = 0U,
+    .interval_multiplier = 1U,
+    .skip_factor = 1U
 };
 
+static peripheral_node_config_t node_config = {
+    .arrival_noise_us = PAWR_ARRIVAL_NOISE_US,
+    .skew_noise_ppb = PAWR_SKEW_NOISE_PPB,
+    .skip_accuracy_us = PAWR_SKIP_ACCURACY_US,
+    .slew_window_ms = PAWR_SLEW_WINDOW_MS,
+    .slew_max_ppm = PAWR_SLEW_MAX_PPM
+};
+
+static clock_estimator_t clock_estimator;
+// Conversions of the sleeptimer ticks, set up at boot
+static clock_scale_t ticks_to_us_scale;
+static clock_scale_t ticks_to_ns_scale;
+static clock_scale_t us_to_ticks_scale;
+static clock_scale_t ns_to_ticks_scale;
 static uint8_t  advertising_set_handle;
-static uint32_t last_subevent_timestamp;
-static int32_t  tick_error_max;
-static int32_t  last_subevent_tick_error = 0;
+// Gateway time and event counter of the last subevent, the reference of the
+// next one without a beacon is a whole number of PAwR intervals later
+static uint64_t last_reference_tick;
+static uint32_t last_reference_fraction;
+static uint16_t last_event_counter;
+static bool     last_event_valid = false;
+// Train of the gateway from the sync transfer, it is opened again with the
+// sync scanner when the sync is lost
+static bd_addr  gateway_address;
+static uint8_t  gateway_address_type;
+static uint8_t  gateway_adv_sid;
+static bool     gateway_known = false;
+// Pending sync of the scanner, the clock runs on the learned skew meanwhile
+static uint16_t resync_handle = SL_BT_INVALID_SYNC_HANDLE;
+static sl_sleeptimer_timer_handle_t resync_timer;
+// Restarted by every subevent received while synchronized. A late subevent
+// is looked for in every event, the train may have been opened again and
+// no subevent heard since.
+static sl_sleeptimer_timer_handle_t subevent_timer;
+static bool     subevent_late = false;
+static bool     subevent_heard = false;
+// PAwR interval of the train, the sync interval is a multiple of it
+static uint32_t pawr_train_interval_ms;
+static uint32_t pawr_train_interval_ticks;
+// Sub-tick part of the PAwR interval, 2^-32 ticks
+static uint32_t pawr_train_interval_fraction;
+// Beacon error of the last subevent, reported to the gateway
+static int8_t   last_beacon_error = 0;
+// Clock offset set by each round trip of the timing exchange
+static int64_t  timing_offsets[PAWR_TIMING_SAMPLES];
+static uint8_t  timing_samples = 0U;
+// A timing exchange set the clock, the corrections from then on are slewed
+static bool     clock_set = false;
+// Provisioned over the connection, the clock correction that ends the timing
+// exchange did not arrive yet
+static bool     timing_exchange_open = false;
+// Copies of the clock get_timestamp() reads, the sequence selects the current one
+static sync_clock_t published_clocks[2];
+static volatile uint32_t clock_sequence = 0U;
+// Records waiting for the response slot, sent one per PAwR interval
+static uplink_record_t uplink_queue[PAWR_UPLINK_QUEUE_LENGTH];
+static uint8_t  uplink_queue_head = 0U;
+static uint8_t  uplink_queue_count = 0U;
+// Sequence numbers of the last downlink commands run
+static uint8_t  last_command_seq = PAWR_INVALID_COMMAND_SEQ;
+static uint8_t  last_broadcast_seq = PAWR_INVALID_COMMAND_SEQ;
+static downlink_command_cb downlink_command_callback = NULL;
+// Subevent and response slot a move command of the gateway asked for, taken
+// after the answer that acknowledges it
+static bool     move_pending = false;
+static uint8_t  move_subevent_id;
+static uint8_t  move_response_slot;
 
 static sl_status_t pawr_update_sync_parameters(uint32_t timeout, uint16_t skip);
 static void peripheral_node_bt_boot();
 static void peripheral_node_bt_connection_parameters(uint8_t connection);
 static void peripheral_node_bt_write_request(sl_bt_msg_t* evt);
+static bool peripheral_node_apply_timing_exchange(const timing_correction_t *record);
 static void peripheral_node_bt_sync_transfer_received(sl_bt_msg_t* evt);
 static void peripheral_node_bt_sync_subevent_report(sl_bt_msg_t* evt);
 static void peripheral_node_bt_connection_closed();
+static void peripheral_node_bt_sync_closed(uint16_t sync);
+static void peripheral_node_bt_sync_opened(sl_bt_msg_t* evt);
+static void peripheral_node_bt_external_signal(uint32_t signals);
+static void peripheral_node_start_resync();
+static void peripheral_node_stop_resync();
+static void peripheral_node_abort_resync();
+static void peripheral_node_rejoin();
+static void peripheral_node_close_train();
+static void resync_timer_callback(sl_sleeptimer_timer_handle_t *handle, void *data);
+static void subevent_timer_callback(sl_sleeptimer_timer_handle_t *handle, void *data);
+static void peripheral_node_start_advertising();
+static void peripheral_node_send_response(sl_bt_msg_t* evt);
+static bool peripheral_node_read_time_beacon(sl_bt_msg_t* evt, uint64_t *reference);
+static void clock_scale_init(clock_scale_t *scale, uint32_t from_hz, uint32_t to_hz);
+static uint64_t clock_scale(uint64_t value, const clock_scale_t *scale);
+static int64_t clock_extrapolation(const sync_clock_t *clock, uint64_t tick);
+static uint64_t clock_synchronized_time(uint64_t tick);
+static int64_t clock_slew_pending(const sync_clock_t *clock, uint64_t tick);
+static uint64_t clock_presented_time(const sync_clock_t *clock, uint64_t tick);
+static uint64_t clock_read_published(sync_clock_t *clock);
+static void clock_publish();
+static void clock_slew_begin(clock_slew_point_t *point);
+static void clock_slew_end(const clock_slew_point_t *point);
+static uint64_t clock_extend(uint64_t reference, uint64_t value, uint8_t bits);
+static void clock_align_epoch(uint64_t tick, uint64_t reference);
+static float clock_us_to_ticks(uint32_t us);
+#if PAWR_RADIO_TIMESTAMP
+static void radio_timestamp_init();
+static bool radio_timestamp_read(uint64_t tick_now, uint64_t expected, float window_sq, uint64_t *arrival);
+static float radio_timestamp_window(uint64_t expected);
+#endif
+static void clock_estimator_reset();
+static void clock_estimator_predict(float dt, float *p_offset, float *p_cross, float *p_skew);
+static int32_t clock_estimator_update(uint64_t tick_now, uint64_t reference);
+static void peripheral_node_set_interval_multiplier(uint8_t multiplier);
+static void peripheral_node_update_skip_factor(int32_t error);
+static bool peripheral_node_skip_fits(uint8_t factor);
+static void peripheral_node_update_sync_skip();
+static void peripheral_node_watch_subevent();
+static bool peripheral_node_receive_commands(sl_bt_msg_t* evt);
+static void peripheral_node_reset_commands();
+static void peripheral_node_move_subevent(uint8_t subevent, uint8_t slot);
 
 
+// Optional, the defaults of ble_time_sync.h apply without it. The values are
+// taken at the next subevent.
+sl_status_t peripheral_node_init(const peripheral_node_config_t *config)
+{
+  if (config->arrival_noise_us == 0U || config->slew_max_ppm == 0U) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  node_config = *config;
+  return SL_STATUS_OK;
+}
+
+// The train was lost and is being looked for, the timestamps run on the
+// learned skew without correction
+bool peripheral_node_in_holdover()
+{
+  return resync_handle != SL_BT_INVALID_SYNC_HANDLE;
+}
+
+// The skew learned is applied continuously between two subevents
 uint32_t get_timestamp()
 {
-  return (sl_sleeptimer_get_tick_count() + time_sync_handle.clock_offset);
+  return (uint32_t)get_timestamp64();
+}
+
+// Does not wrap: the upper half follows the epoch of the gateway. Monotonic
+// once the first timing exchange set it. The only exception is a correction
+// back by more than PAWR_SLEW_MAX_HOLD_MS, i.e. a gateway that started its
+// time over, which is stepped.
+uint64_t get_timestamp64()
+{
+  sync_clock_t clock;
+  uint64_t tick = clock_read_published(&clock);
+  return clock_presented_time(&clock, tick);
+}
+
+uint64_t peripheral_node_ticks_to_us(uint64_t ticks)
+{
+  return clock_scale(ticks, &ticks_to_us_scale);
+}
+
+uint64_t peripheral_node_ticks_to_ns(uint64_t ticks)
+{
+  return clock_scale(ticks, &ticks_to_ns_scale);
+}
+
+uint64_t peripheral_node_us_to_ticks(uint64_t us)
+{
+  return clock_scale(us, &us_to_ticks_scale);
+}
+
+uint64_t peripheral_node_ns_to_ticks(uint64_t ns)
+{
+  return clock_scale(ns, &ns_to_ticks_scale);
+}
+
+// Queue a payload for the next response slots, it is stamped with the
+// synchronized time now. Delivery is best effort, nothing is repeated.
+sl_status_t peripheral_node_send_uplink_data(const uint8_t *data, uint8_t len)
+{
+  if (len > PAWR_UPLINK_MAX_PAYLOAD) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (uplink_queue_count == PAWR_UPLINK_QUEUE_LENGTH) {
+    return SL_STATUS_FULL;
+  }
+  uplink_record_t *record = &uplink_queue[(uplink_queue_head + uplink_queue_count) % PAWR_UPLINK_QUEUE_LENGTH];
+  record->timestamp = get_timestamp();
+  record->len = len;
+  memcpy(record->data, data, len);
+  uplink_queue_count++;
+  return SL_STATUS_OK;
+}
+
+void peripheral_node_set_command_callback(downlink_command_cb callback)
+{
+  downlink_command_callback = callback;
 }
 
 void peripheral_node_on_bt_event(sl_bt_msg_t* evt)
@@ -76,7 +323,15 @@ void peripheral_node_on_bt_event(sl_bt_msg_t* evt)
     break;
 
     case sl_bt_evt_sync_closed_id:
-      time_sync_handle.sync_handle = SL_BT_INVALID_SYNC_HANDLE;
+      peripheral_node_bt_sync_closed(evt->data.evt_sync_closed.sync);
+    break;
+
+    case sl_bt_evt_pawr_sync_opened_id:
+      peripheral_node_bt_sync_opened(evt);
+    break;
+
+    case sl_bt_evt_system_external_signal_id:
+      peripheral_node_bt_external_signal(evt->data.evt_system_external_signal.extsignals);
     break;
     // -------------------------------
     // Default event handler.
@@ -123,14 +378,17 @@ static sl_status_t pawr_update_sync_parameters(uint32_t timeout, uint16_t skip)
 static void peripheral_node_bt_boot()
 {
   sl_status_t sc;
+  uint32_t frequency = sl_sleeptimer_get_timer_frequency();
+  clock_scale_init(&ticks_to_us_scale, frequency, 1000000U);
+  clock_scale_init(&ticks_to_ns_scale, frequency, 1000000000U);
+  clock_scale_init(&us_to_ticks_scale, 1000000U, frequency);
+  clock_scale_init(&ns_to_ticks_scale, 1000000000U, frequency);
+#if PAWR_RADIO_TIMESTAMP
+  radio_timestamp_init();
+#endif
   sc = sl_bt_advertiser_create_set(&advertising_set_handle);
   app_assert_status(sc);
 
-  // Generate data for advertising
-  sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
-                                             sl_bt_advertiser_general_discoverable);
-  app_assert_status(sc);
-
   // Set advertising interval to 100ms.
   sc = sl_bt_advertiser_set_timing(
     advertising_set_handle,
@@ -139,6 +397,18 @@ static void peripheral_node_bt_boot()
     0,   // adv. duration
     0);  // max. num. adv. events
   app_assert_status(sc);
+  peripheral_node_start_advertising();
+}
+
+
+static void peripheral_node_start_advertising()
+{
+  sl_status_t sc;
+  // Generate data for advertising
+  sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
+                                             sl_bt_advertiser_general_discoverable);
+  app_assert_status(sc);
+
   // Start advertising and enable connections.
   sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
                                      sl_bt_advertiser_connectable_scannable);
@@ -163,22 +433,73 @@ static void peripheral_node_bt_write_request(sl_bt_msg_t* evt)
 {
   sl_status_t sc;
   if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_wall_clock_time) {
-      CORE_ATOMIC_SECTION(
-          uint32_t wall_clock_time = *(uint32_t*)evt->data.evt_gatt_server_attribute_value.value.data;
-          time_sync_handle.clock_offset = (int32_t)wall_clock_time - sl_sleeptimer_get_tick_count();
-      );
+      timing_sample_t record = { .sample = PAWR_TIMING_SAMPLES };
+      size_t len = (evt->data.evt_gatt_server_user_write_request.value.len < sizeof(record))
+                   ? sizeof(record.gateway_tick) : sizeof(record);
+      memcpy(&record, evt->data.evt_gatt_server_user_write_request.value.data, len);
+      uint64_t tick = sl_sleeptimer_get_tick_count64();
+      // the epoch is the one nearest the current time, the next beacon aligns it
+      uint64_t wall_clock = clock_extend(clock_synchronized_time(tick), record.gateway_tick, 32U);
+      if (record.sample < PAWR_TIMING_SAMPLES) {
+        // taken over with the clock correction
+        timing_samples = (record.sample == 0U) ? 0U : timing_samples;
+        timing_samples |= 1U << record.sample;
+        timing_offsets[record.sample] = (int64_t)(wall_clock - tick);
+      } else {
+        clock_slew_point_t slew;
+        clock_slew_begin(&slew);
+        clock_estimator_reset();
+        time_sync_handle.clock.offset = (int64_t)(wall_clock - tick);
+        clock_slew_end(&slew);
+      }
   }
   if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_clock_correction) {
-      CORE_ATOMIC_SECTION(
+      if (evt->data.evt_gatt_server_user_write_request.value.len >= sizeof(timing_correction_t)) {
+          timing_correction_t record;
+          memcpy(&record, evt->data.evt_gatt_server_user_write_request.value.data, sizeof(record));
+          clock_slew_point_t slew;
+          clock_slew_begin(&slew);
+          timing_exchange_open = false;
+          if (peripheral_node_apply_timing_exchange(&record)) {
+            clock_slew_end(&slew);
+            clock_set = true;
+          }
+      } else {
+          clock_slew_point_t slew;
+          clock_slew_begin(&slew);
           uint32_t clock_correction = *(uint32_t*)evt->data.evt_gatt_server_attribute_value.value.data;
-          time_sync_handle.clock_offset += clock_correction;
-      );
+          time_sync_handle.clock.offset += (int32_t)clock_correction;
+          clock_slew_end(&slew);
+          clock_set = true;
+          timing_exchange_open = false;
+      }
   }
   if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_peripheral_node_id) {
       time_sync_handle.id = evt->data.evt_gatt_server_attribute_value.value.data[0];
+      peripheral_node_reset_commands();
+      timing_exchange_open = true;
+  }
+  if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_provisioning
+      && evt->data.evt_gatt_server_user_write_request.value.len >= sizeof(provisioning_record_t)) {
+      provisioning_record_t record;
+      memcpy(&record, evt->data.evt_gatt_server_user_write_request.value.data, sizeof(record));
+      time_sync_handle.id = record.node_id;
+      time_sync_handle.subevent_id = record.subevent_id;
+      time_sync_handle.response_slot = record.response_slot;
+      time_sync_handle.pawr_interval = record.pawr_interval;
+      peripheral_node_reset_commands();
+      timing_exchange_open = true;
   }
   if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_subevent_id) {
       time_sync_handle.subevent_id = evt->data.evt_gatt_server_attribute_value.value.data[0];
+      // the response slot follows the subevent ID, older gateways omit it
+      if (evt->data.evt_gatt_server_user_write_request.value.len > 1) {
+          time_sync_handle.response_slot = evt->data.evt_gatt_server_user_write_request.value.data[1];
+      }
+      // the gateway moves synchronized nodes when it rebalances its subevents
+      if (time_sync_handle.sync_handle != SL_BT_INVALID_SYNC_HANDLE) {
+          peripheral_node_move_subevent(time_sync_handle.subevent_id, time_sync_handle.response_slot);
+      }
   }
   // send response only if required by the client
   if (evt->data.evt_gatt_server_user_write_request.att_opcode == sl_bt_gatt_write_request) {
@@ -190,28 +511,80 @@ static void peripheral_node_bt_write_request(sl_bt_msg_t* evt)
 }
 
 
+// Every round trip of the timing exchange sets the clock half of its duration
+// early, so the offset is the average of the selected ones plus half of their
+// average duration. The remainder of the average goes to the clock fraction.
+static bool peripheral_node_apply_timing_exchange(const timing_correction_t *record)
+{
+  uint8_t samples = record->samples & timing_samples;
+  int64_t base = 0;
+  int64_t sum = 0;
+  int64_t count = 0;
+  for (uint8_t i = 0; i < PAWR_TIMING_SAMPLES; i++) {
+    if (samples & (1U << i)) {
+      if (count == 0) {
+        base = timing_offsets[i];
+      }
+      sum += timing_offsets[i] - base;
+      count++;
+    }
+  }
+  // none of the round trips reached the node, the clock stays
+  if (count == 0) {
+    return false;
+  }
+  clock_estimator_reset();
+  sum = 2 * sum + record->round_trips;
+  int64_t whole = sum / (2 * count);
+  int64_t rest = sum % (2 * count);
+  if (rest < 0) {
+    whole--;
+    rest += 2 * count;
+  }
+  time_sync_handle.clock.offset = base + whole;
+  time_sync_handle.clock.fraction = (uint32_t)(((uint64_t)rest << 32) / (uint64_t)(2 * count));
+  return true;
+}
+
+
 static void peripheral_node_bt_sync_transfer_received(sl_bt_msg_t* evt)
 {
   sl_status_t sc;
-  if (evt->data.evt_pawr_sync_transfer_received.status == SL_STATUS_OK) {
-    last_subevent_timestamp = sl_sleeptimer_get_tick_count();
+  // a provisioned node takes the train of its own gateway only, and not
+  // after the gateway dropped it while the transfer was on the way
+  if (time_sync_handle.pawr_interval != 0U
+      && (evt->data.evt_pawr_sync_transfer_received.adv_interval != time_sync_handle.pawr_interval
+          || time_sync_handle.response_slot == INVALID_RESPONSE_SLOT)) {
+    sc = sl_bt_sync_close(evt->data.evt_pawr_sync_transfer_received.sync);
+    app_assert_status(sc);
+  } else if (evt->data.evt_pawr_sync_transfer_received.status == SL_STATUS_OK) {
+    // the estimate goes on from where it is, the skew is learned again
+    clock_estimator_reset();
+    clock_publish();
+    last_event_valid = false;
     // get the base for the timeout value from the adv_interval that arrives in unit of 1.25 ms
     uint32_t pawr_interval_ms = (10 * evt->data.evt_pawr_sync_transfer_received.adv_interval) / 8;
     // accept the sync transfer only from the bonded AP according to ESL spec.
 
     time_sync_handle.sync_handle = evt->data.evt_pawr_sync_transfer_received.sync;
+    gateway_address = evt->data.evt_pawr_sync_transfer_received.address;
+    gateway_address_type = evt->data.evt_pawr_sync_transfer_received.address_type;
+    gateway_adv_sid = evt->data.evt_pawr_sync_transfer_received.adv_sid;
+    gateway_known = true;
 
-    pawr_update_sync_parameters(pawr_interval_ms, PAWR_SYNC_SKIP);
-
-    uint32_t pawr_interval_ticks;
-      // due to the earlier multiplication trick, this will always give an
-      // integer value equal to one hundred times the current interval!
-    (void)sl_sleeptimer_ms32_to_tick(pawr_interval_ms, &pawr_interval_ticks);
-    // correction with 36 ppm
-    pawr_interval_ticks -= (36 * pawr_interval_ticks / 1000000U);
-    // calculation of tick error (max. 20 ppm)
-    tick_error_max = (20 * pawr_interval_ticks / 1000000U);
-    time_sync_handle.pawr_interval_ticks = pawr_interval_ticks;
+    pawr_train_interval_ms = pawr_interval_ms;
+    // a whole number of 1.25 ms is not a whole number of ticks, the fraction
+    // keeps the references without a beacon from drifting
+    uint64_t interval = (uint64_t)evt->data.evt_pawr_sync_transfer_received.adv_interval
+                        * sl_sleeptimer_get_timer_frequency();
+    pawr_train_interval_ticks = (uint32_t)(interval / 800U);
+    pawr_train_interval_fraction = (uint32_t)(((interval % 800U) << 32) / 800U);
+    // every event is received until the first beacon tells the sync interval
+    time_sync_handle.skip_factor = 1U;
+    subevent_late = false;
+    subevent_heard = false;
+    peripheral_node_set_interval_multiplier(1U);
+    peripheral_node_watch_subevent();
     sc = sl_bt_pawr_sync_set_sync_subevents(time_sync_handle.sync_handle,
                                              sizeof(time_sync_handle.subevent_id),
                                              &(time_sync_handle.subevent_id));
@@ -226,56 +599,752 @@ static void peripheral_node_bt_sync_transfer_received(sl_bt_msg_t* evt)
 
 static void peripheral_node_bt_sync_subevent_report(sl_bt_msg_t* evt)
 {
-  // skip any incomplete data
-   if (evt->data.evt_pawr_sync_subevent_report.data_status == 0) {
-     uint32_t tick_now = sl_sleeptimer_get_tick_count();
-     uint32_t ticks_elapsed;
-     int32_t  tick_error;
-
-     ticks_elapsed = (uint32_t)(tick_now - last_subevent_timestamp);
-
-     if ((int32_t)ticks_elapsed < 0) {
-         ticks_elapsed = -ticks_elapsed;
+  // skip any incomplete data, and every subevent until the timing exchange
+  // is over, the train is handed over while it is still going on
+   if (timing_exchange_open) {
+     peripheral_node_watch_subevent();
+   } else if (evt->data.evt_pawr_sync_subevent_report.data_status == 0) {
+     uint64_t tick_now = sl_sleeptimer_get_tick_count64();
+     subevent_heard = true;
+     if (subevent_late) {
+       subevent_late = false;
+       peripheral_node_update_sync_skip();
      }
-
-     tick_error = (int32_t)(ticks_elapsed - time_sync_handle.pawr_interval_ticks);
-     ticks_elapsed = (uint32_t)(tick_now - last_subevent_timestamp);
-
-     if ((int32_t)ticks_elapsed < 0) {
-         ticks_elapsed = -ticks_elapsed;
+     // the event counter tells how many PAwR intervals passed, missed
+     // subevents included, the gateway time follows them without a beacon
+     uint16_t events = evt->data.evt_pawr_sync_subevent_report.event_counter - last_event_counter;
+     uint64_t fraction = last_reference_fraction + (uint64_t)events * pawr_train_interval_fraction;
+     uint64_t reference = last_reference_tick + (uint64_t)events * pawr_train_interval_ticks + (fraction >> 32);
+     bool beacon = peripheral_node_read_time_beacon(evt, &reference);
+     if (beacon) {
+       fraction = 0U;
+       clock_align_epoch(tick_now, reference);
      }
-
-     tick_error = (int32_t)(ticks_elapsed - time_sync_handle.pawr_interval_ticks);
-     //================================================
-     if (tick_error > tick_error_max || tick_error < -tick_error_max) {
-        CORE_ATOMIC_SECTION(
-            time_sync_handle.clock_offset -= last_subevent_tick_error;
-        );
+#if PAWR_RADIO_TIMESTAMP
+     // the arrival at the radio does not depend on the event queue. With a
+     // connection open its packets after the subevent are captured as well, a
+     // capture away from the arrival the estimate predicts is then not used.
+     if (time_sync_handle.connection_handle != SL_BT_INVALID_CONNECTION_HANDLE
+         && (beacon || last_event_valid)) {
+       uint64_t expected = tick_now - (clock_synchronized_time(tick_now) - reference);
+       radio_timestamp_read(tick_now, expected, radio_timestamp_window(expected), &tick_now);
+     } else {
+       radio_timestamp_read(tick_now, tick_now, FLT_MAX, &tick_now);
+     }
+#endif
+     if (beacon || last_event_valid) {
+       int32_t error = clock_estimator_update(tick_now, reference);
+       if (beacon) {
+         last_beacon_error = (int8_t)((error > INT8_MAX) ? INT8_MAX : (error < INT8_MIN) ? INT8_MIN : error);
+         peripheral_node_update_skip_factor(error);
+       }
      } else {
-        CORE_ATOMIC_SECTION(
-            time_sync_handle.clock_offset -= tick_error;
-        );
-        last_subevent_tick_error = tick_error;
+       // the first subevent after the sync starts the intervals
+       reference = clock_synchronized_time(tick_now);
+       fraction = 0U;
+     }
+     last_reference_tick = reference;
+     last_reference_fraction = (uint32_t)fraction;
+     last_event_counter = evt->data.evt_pawr_sync_subevent_report.event_counter;
+     last_event_valid = true;
+     // the response acknowledges the commands and reports the beacon error of
+     // this subevent, a node being commanded listens to every sync interval
+     if (peripheral_node_receive_commands(evt) && time_sync_handle.skip_factor > 1U) {
+       time_sync_handle.skip_factor = 1U;
+       peripheral_node_update_sync_skip();
+     }
+     peripheral_node_watch_subevent();
+     peripheral_node_send_response(evt);
+     if (move_pending) {
+       move_pending = false;
+       peripheral_node_move_subevent(move_subevent_id, move_response_slot);
      }
-//=================================================
-     // save current tick count
-     last_subevent_timestamp = tick_now;
    }
 }
 
 
-static void peripheral_node_bt_connection_closed()
+// The gateway time in the subevent is the reference of the clock estimator,
+// so the error does not build up between two provisionings. The 40 bits of
+// the beacon are extended around the expected reference.
+static bool peripheral_node_read_time_beacon(sl_bt_msg_t* evt, uint64_t *reference)
+{
+  pawr_time_beacon_t beacon;
+  uint64_t gateway_time;
+  if (evt->data.evt_pawr_sync_subevent_report.data.len < sizeof(beacon)) {
+    return false;
+  }
+  memcpy(&beacon, evt->data.evt_pawr_sync_subevent_report.data.data, sizeof(beacon));
+  gateway_time = ((uint64_t)beacon.epoch << 32) | beacon.gateway_tick;
+  *reference = clock_extend(*reference, gateway_time, CLOCK_BEACON_TIME_BITS);
+  time_sync_handle.gateway_epoch = beacon.epoch;
+  if (beacon.interval_multiplier != 0U && beacon.interval_multiplier != time_sync_handle.interval_multiplier) {
+    peripheral_node_set_interval_multiplier(beacon.interval_multiplier);
+  }
+  return true;
+}
+
+
+// The multiplier is precomputed for the largest shift that keeps it in 32
+// bits, so a conversion takes two multiplications and no division
+static void clock_scale_init(clock_scale_t *scale, uint32_t from_hz, uint32_t to_hz)
+{
+  double ratio = (double)to_hz / from_hz;
+  uint8_t shift = 0U;
+  while (shift < 63U && ratio * 2.0 < 4294967296.0) {
+    ratio *= 2.0;
+    shift++;
+  }
+  scale->multiplier = (uint32_t)ratio;
+  scale->shift = shift;
+}
+
+
+static uint64_t clock_scale(uint64_t value, const clock_scale_t *scale)
+{
+  uint64_t high = (value >> 32) * scale->multiplier;
+  uint64_t low = (value & 0xFFFFFFFFULL) * scale->multiplier;
+  if (scale->shift >= 32U) {
+    return (high + (low >> 32)) >> (scale->shift - 32U);
+  }
+  return (high << (32U - scale->shift)) + (low >> scale->shift);
+}
+
+
+// Sub-tick offset and the skew accumulated since the last correction, in
+// 2^-32 ticks
+static int64_t clock_extrapolation(const sync_clock_t *clock, uint64_t tick)
+{
+  int64_t elapsed = (int64_t)(tick - clock->skew_anchor_tick);
+  return elapsed * clock->skew + clock->fraction;
+}
+
+
+// The estimate itself, for the stack context only
+static uint64_t clock_synchronized_time(uint64_t tick)
+{
+  const sync_clock_t *clock = &time_sync_handle.clock;
+  return tick + (uint64_t)clock->offset + (uint64_t)(clock_extrapolation(clock, tick) >> 32);
+}
+
+
+// Part of the last correction not presented by get_timestamp() yet, in 2^-32
+// ticks
+static int64_t clock_slew_pending(const sync_clock_t *clock, uint64_t tick)
+{
+  int64_t elapsed = (int64_t)(tick - clock->slew_anchor_tick);
+  if (elapsed >= (int64_t)clock->slew_ticks) {
+    return 0;
+  }
+  if (elapsed < 0) {
+    elapsed = 0;
+  }
+  return clock->slew_remaining - elapsed * clock->slew_rate;
+}
+
+
+static uint64_t clock_presented_time(const sync_clock_t *clock, uint64_t tick)
+{
+  int64_t extrapolation = clock_extrapolation(clock, tick) - clock_slew_pending(clock, tick);
+  return tick + (uint64_t)clock->offset + (uint64_t)(extrapolation >> 32);
+}
+
+
+// Called before the estimate is corrected, in the same atomic section
+static void clock_slew_begin(clock_slew_point_t *point)
+{
+  const sync_clock_t *clock = &time_sync_handle.clock;
+  point->tick = sl_sleeptimer_get_tick_count64();
+  point->offset = clock->offset;
+  point->extrapolation = clock_extrapolation(clock, point->tick);
+  point->pending = clock_slew_pending(clock, point->tick);
+}
+
+
+// The presented time continues from where it was at the start of the
+// correction. The difference to the corrected estimate runs out over the
+// slew window, or longer if the rate would exceed the bound. Each tick adds
+// far more than the slew takes, so the presented time does not go back.
+// A forward difference that would take longer than the hold bound runs out
+// within it at a higher rate, beyond the step bound or without a window it
+// is stepped. A backward one that the bounded rate cannot take over within
+// the hold bound holds the time: it advances by no more than twice the
+// largest skew until the estimate caught up, and never goes back with a
+// negative skew either.
+static void clock_slew_end(const clock_slew_point_t *point)
+{
+  sync_clock_t *clock = &time_sync_handle.clock;
+  uint64_t frequency = sl_sleeptimer_get_timer_frequency();
+  int64_t max_step = (int64_t)(PAWR_SLEW_MAX_STEP_MS * frequency / 1000U);
+  uint64_t max_hold = PAWR_SLEW_MAX_HOLD_MS * frequency / 1000U;
+  int64_t step = clock->offset - point->offset;
+  clock->slew_remaining = 0;
+  clock->slew_rate = 0;
+  clock->slew_ticks = 0U;
+  clock->slew_anchor_tick = point->tick;
+  if (clock_set && step <= (int64_t)max_hold && step >= -(int64_t)max_hold) {
+    int64_t difference = (int64_t)((uint64_t)step << 32)
+                         + (clock_extrapolation(clock, point->tick) - point->extrapolation) + point->pending;
+    uint64_t magnitude = (uint64_t)(difference < 0 ? -difference : difference);
+    uint64_t duration = 0U;
+    if (node_config.slew_window_ms != 0U && magnitude <= ((uint64_t)max_step << 32)) {
+      uint64_t max_rate = ((uint64_t)node_config.slew_max_ppm << 32) / 1000000U;
+      duration = (uint64_t)node_config.slew_window_ms * frequency / 1000U;
+      if (magnitude / max_rate > duration) {
+        duration = magnitude / max_rate;
+      }
+      if (duration > max_hold && difference > 0) {
+        duration = max_hold;
+      }
+    }
+    if (difference < 0 && (duration == 0U || duration > max_hold)) {
+      uint64_t hold_rate = (1ULL << 32) - 2U * (((uint64_t)PAWR_MAX_SKEW_PPM << 32) / 1000000U);
+      duration = magnitude / hold_rate + 1U;
+    }
+    if (duration != 0U && duration <= max_hold) {
+      clock->slew_remaining = difference;
+      clock->slew_rate = difference / (int64_t)duration;
+      clock->slew_ticks = (uint32_t)duration;
+    }
+  }
+  clock_publish();
+}
+
+
+// Written by the stack context only: the copy not in use is filled, then the
+// sequence switches the readers over to it
+static void clock_publish()
+{
+  uint32_t sequence = clock_sequence + 1U;
+  published_clocks[sequence & 1U] = time_sync_handle.clock;
+  __DMB();
+  clock_sequence = sequence;
+}
+
+
+// Wait-free in interrupts, the writer cannot run while one reads. A thread
+// retries only if a publication overtook it. The tick is read in the loop as
+// well, so it is never older than the correction it is presented with.
+static uint64_t clock_read_published(sync_clock_t *clock)
+{
+  uint32_t sequence;
+  uint64_t tick;
+  do {
+    sequence = clock_sequence;
+    __DMB();
+    tick = sl_sleeptimer_get_tick_count64();
+    *clock = published_clocks[sequence & 1U];
+    __DMB();
+  } while (sequence != clock_sequence);
+  return tick;
+}
+
+
+// Extends the lower bits of a time to the 64-bit value nearest the reference
+static uint64_t clock_extend(uint64_t reference, uint64_t value, uint8_t bits)
+{
+  int64_t difference = (int64_t)((value - reference) << (64U - bits));
+  return reference + (uint64_t)(difference >> (64U - bits));
+}
+
+
+// The wall clock write sets the lower 32 bits only, a difference of whole
+// epochs to the beacon is taken over at once
+static void clock_align_epoch(uint64_t tick, uint64_t reference)
+{
+  int64_t error = (int64_t)(reference - clock_synchronized_time(tick));
+  if (error > INT32_MAX || error < INT32_MIN) {
+    clock_slew_point_t slew;
+    clock_slew_begin(&slew);
+    time_sync_handle.clock.offset += error - (int32_t)error;
+    clock_slew_end(&slew);
+  }
+}
+
+
+#if PAWR_RADIO_TIMESTAMP
+// The frame detection of a received packet latches the sleeptimer counter
+// through PRS, the sleeptimer itself runs on group 0 of the SYSRTC
+static void radio_timestamp_init()
+{
+  int channel = PRS_GetFreeChannel(prsTypeAsync);
+  app_assert(channel >= 0, "No free PRS channel for the radio timestamp\n");
+  PRS_ConnectSignal((unsigned int)channel, prsTypeAsync, (PRS_Signal_t)PRS_MODEM_FRAMEDET);
+  PRS_ConnectConsumer((unsigned int)channel, prsTypeAsync, prsConsumerSYSRTC0_SRC0);
+  sl_sysrtc_unlock();
+  SYSRTC0->GRP0_CTRL |= SYSRTC_GRP0_CTRL_CAP0EN | SYSRTC_GRP0_CTRL_CAP0EDGE_RISING;
+  sl_sysrtc_lock();
+  sl_sysrtc_clear_group_interrupts(0U, SYSRTC_GRP0_IF_CAP0);
+}
+
+
+// Arrival of the last packet received since the previous read. Without one,
+// if it is too old to be the subevent or its square distance to the expected
+// arrival exceeds the window, the arrival is left unchanged.
+static bool radio_timestamp_read(uint64_t tick_now, uint64_t expected, float window_sq, uint64_t *arrival)
+{
+  uint64_t captured;
+  if (!(sl_sysrtc_get_group_interrupts(0U) & SYSRTC_GRP0_IF_CAP0)) {
+    return false;
+  }
+  sl_sysrtc_clear_group_interrupts(0U, SYSRTC_GRP0_IF_CAP0);
+  captured = clock_extend(tick_now, sl_sysrtc_get_group_capture_channel_value(0U), 32U);
+  float distance = (float)(int64_t)(captured - expected);
+  if (captured > tick_now
+      || tick_now - captured > peripheral_node_us_to_ticks(RADIO_TIMESTAMP_MAX_AGE_US)
+      || distance * distance > window_sq) {
+    return false;
+  }
+  *arrival = captured;
+  return true;
+}
+
+
+// Square of the window around the predicted arrival: the outlier bound of the
+// offset the estimator predicts, at least RADIO_TIMESTAMP_WINDOW_US
+static float radio_timestamp_window(uint64_t expected)
+{
+  float p_offset, p_cross, p_skew;
+  float window = clock_us_to_ticks(RADIO_TIMESTAMP_WINDOW_US);
+  clock_estimator_predict((float)(int64_t)(expected - time_sync_handle.clock.skew_anchor_tick),
+                          &p_offset, &p_cross, &p_skew);
+  p_offset *= CLOCK_OUTLIER_SIGMA * CLOCK_OUTLIER_SIGMA;
+  return (p_offset > window * window) ? p_offset : window * window;
+}
+#endif
+
+
+static float clock_us_to_ticks(uint32_t us)
+{
+  return (float)us * (float)sl_sleeptimer_get_timer_frequency() / 1000000.0f;
+}
+
+
+// A new timing exchange or sync starts the estimator over, the skew is
+// unknown. The extrapolation so far is kept in the offset.
+static void clock_estimator_reset()
+{
+  uint64_t tick = sl_sleeptimer_get_tick_count64();
+  float offset_ticks = clock_us_to_ticks(CLOCK_INITIAL_OFFSET_US);
+  time_sync_handle.clock.offset += clock_extrapolation(&time_sync_handle.clock, tick) >> 32;
+  clock_estimator.skew_ppm = 0.0f;
+  clock_estimator.p_offset = offset_ticks * offset_ticks;
+  clock_estimator.p_cross = 0.0f;
+  clock_estimator.p_skew = (float)PAWR_MAX_SKEW_PPM * PAWR_MAX_SKEW_PPM;
+  clock_estimator.outliers = 0U;
+  time_sync_handle.clock.fraction = 0U;
+  time_sync_handle.clock.skew = 0;
+  time_sync_handle.clock.skew_anchor_tick = tick;
+}
+
+
+// Covariance of the estimate dt ticks after the last correction
+static void clock_estimator_predict(float dt, float *p_offset, float *p_cross, float *p_skew)
+{
+  clock_estimator_t *kf = &clock_estimator;
+  float a = dt * 1e-6f;
+  float skew_noise = (float)node_config.skew_noise_ppb * 1e-3f;
+  float q = skew_noise * skew_noise * dt / (float)sl_sleeptimer_get_timer_frequency();
+  *p_offset = kf->p_offset + 2.0f * a * kf->p_cross + a * a * kf->p_skew + q * a * a / 3.0f;
+  *p_cross = kf->p_cross + a * kf->p_skew + q * a / 2.0f;
+  *p_skew = kf->p_skew + q;
+}
+
+
+// Two-state Kalman filter: the offset drifts with the skew, the skew takes a
+// random walk. The measurement is the gateway time at the subevent against
+// the synchronized time. Innovations beyond CLOCK_OUTLIER_SIGMA standard
+// deviations are dropped, a lasting step is taken over after
+// CLOCK_MAX_OUTLIERS of them. Returns the innovation in ticks.
+static int32_t clock_estimator_update(uint64_t tick_now, uint64_t reference)
+{
+  clock_estimator_t *kf = &clock_estimator;
+  float r = clock_us_to_ticks(node_config.arrival_noise_us);
+  float p_offset, p_cross, p_skew, s, gain_offset, gain_skew;
+  int64_t extrapolation = clock_extrapolation(&time_sync_handle.clock, tick_now);
+  int32_t error = (int32_t)(reference - tick_now - (uint64_t)time_sync_handle.clock.offset);
+  float innovation = (float)error - (float)extrapolation / 4294967296.0f;
+
+  clock_estimator_predict((float)(tick_now - time_sync_handle.clock.skew_anchor_tick), &p_offset, &p_cross, &p_skew);
+  s = p_offset + r * r;
+  if (innovation * innovation > CLOCK_OUTLIER_SIGMA * CLOCK_OUTLIER_SIGMA * s) {
+    if (++kf->outliers < CLOCK_MAX_OUTLIERS) {
+      return (int32_t)innovation;
+    }
+    // the offset stepped, the step is taken over with the skew kept
+    p_offset = innovation * innovation;
+    p_cross = 0.0f;
+    s = p_offset + r * r;
+  }
+  kf->outliers = 0U;
+
+  // correction
+  gain_offset = p_offset / s;
+  gain_skew = p_cross / s;
+  kf->p_offset = (1.0f - gain_offset) * p_offset;
+  kf->p_cross = (1.0f - gain_offset) * p_cross;
+  kf->p_skew = p_skew - gain_skew * p_cross;
+  kf->skew_ppm += gain_skew * innovation;
+  if (kf->skew_ppm > PAWR_MAX_SKEW_PPM) {
+    kf->skew_ppm = PAWR_MAX_SKEW_PPM;
+  } else if (kf->skew_ppm < -PAWR_MAX_SKEW_PPM) {
+    kf->skew_ppm = -PAWR_MAX_SKEW_PPM;
+  }
+  extrapolation += (int64_t)(gain_offset * innovation * 4294967296.0f);
+  clock_slew_point_t slew;
+  clock_slew_begin(&slew);
+  time_sync_handle.clock.offset += extrapolation >> 32;
+  time_sync_handle.clock.fraction = (uint32_t)extrapolation;
+  time_sync_handle.clock.skew = (int32_t)(kf->skew_ppm * CLOCK_SKEW_PPM_SCALE);
+  time_sync_handle.clock.skew_anchor_tick = tick_now;
+  clock_slew_end(&slew);
+  return (int32_t)innovation;
+}
+
+
+// The gateway sends the subevent every multiplier PAwR intervals, the events
+// in between are skipped
+static void peripheral_node_set_interval_multiplier(uint8_t multiplier)
+{
+  time_sync_handle.pawr_interval_ticks = pawr_train_interval_ticks * multiplier;
+  time_sync_handle.interval_multiplier = multiplier;
+  // a longer sync interval may leave too few skipped ones for the sync timeout
+  while (time_sync_handle.skip_factor > 1U && !peripheral_node_skip_fits(time_sync_handle.skip_factor)) {
+    time_sync_handle.skip_factor /= 2U;
+  }
+  peripheral_node_update_sync_skip();
+}
+
+
+// The node skips sync intervals on its own while the estimator predicts its
+// clock within skip_accuracy_us over two skips, so a lost subevent is covered,
+// one step per subevent. An error beyond it, an outlier or uplink and
+// downlink traffic bring it back to every sync interval.
+static void peripheral_node_update_skip_factor(int32_t error)
+{
+  float p_offset, p_cross, p_skew;
+  float accuracy = clock_us_to_ticks(node_config.skip_accuracy_us);
+  uint8_t factor = time_sync_handle.skip_factor;
+  if (node_config.skip_accuracy_us == 0U || clock_estimator.outliers > 0U
+      || (float)error > accuracy || (float)error < -accuracy || uplink_queue_count > 0U) {
+    factor = 1U;
+  } else if (factor < PAWR_MAX_SKIP_FACTOR && peripheral_node_skip_fits(2U * factor)) {
+    clock_estimator_predict(4.0f * factor * time_sync_handle.pawr_interval_ticks, &p_offset, &p_cross, &p_skew);
+    if (p_offset <= accuracy * accuracy) {
+      factor *= 2U;
+    }
+  }
+  if (factor != time_sync_handle.skip_factor) {
+    time_sync_handle.skip_factor = factor;
+    peripheral_node_update_sync_skip();
+  }
+}
+
+
+// The sync timeout grows with the skip, PAWR_MAX_SYNC_LOST skipped intervals
+// have to fit in it
+static bool peripheral_node_skip_fits(uint8_t factor)
+{
+  uint32_t timeout = (PAWR_MAX_SYNC_LOST * pawr_train_interval_ms + PAWR_MIN_SYNC_TIMEOUT) / 10U;
+  return timeout * time_sync_handle.interval_multiplier * factor <= PAWR_SYNC_MAX_TIMEOUT;
+}
+
+
+static void peripheral_node_update_sync_skip()
+{
+  uint16_t skip = (PAWR_SYNC_SKIP + 1U) * time_sync_handle.interval_multiplier * time_sync_handle.skip_factor - 1U;
+  pawr_update_sync_parameters(pawr_train_interval_ms, subevent_late ? 0U : skip);
+}
+
+
+// An empty subevent does not break the sync. A node skipping onto events the
+// gateway does not send anymore, e.g. after it lengthened the sync interval,
+// listens to every event once the subevent is late. If it stays silent as
+// long as a lost sync would, the sync is closed as lost.
+static void peripheral_node_watch_subevent()
+{
+  uint32_t timeout = (PAWR_MAX_SYNC_LOST + 1U) * time_sync_handle.pawr_interval_ticks;
+  if (!subevent_late && time_sync_handle.interval_multiplier * time_sync_handle.skip_factor > 1U) {
+    timeout = (2U * time_sync_handle.skip_factor + 1U) * time_sync_handle.pawr_interval_ticks;
+  }
+  (void)sl_sleeptimer_restart_timer(&subevent_timer, timeout, subevent_timer_callback, NULL, 0, 0);
+}
+
+
+// Commands follow the time beacon in the subevent data. A command is repeated
+// until its acknowledgement arrives, so it runs only if its sequence number
+// differs from the last one run. Returns whether a command ran.
+static bool peripheral_node_receive_commands(sl_bt_msg_t* evt)
+{
+  pawr_command_header_t header;
+  uint8_t *last_seq;
+  const uint8_t *data = evt->data.evt_pawr_sync_subevent_report.data.data;
+  uint16_t len = evt->data.evt_pawr_sync_subevent_report.data.len;
+  uint16_t i = sizeof(pawr_time_beacon_t);
+  bool received = false;
+  while (i + PAWR_COMMAND_HEADER_LENGTH <= len) {
+    memcpy(&header, &data[i], sizeof(header));
+    i += PAWR_COMMAND_HEADER_LENGTH;
+    if (header.len > len - i) {
+      return received;
+    }
+    last_seq = NULL;
+    if (header.node_id == PAWR_BROADCAST_NODE_ID) {
+      last_seq = &last_broadcast_seq;
+    } else if (header.node_id == time_sync_handle.id) {
+      last_seq = &last_command_seq;
+    }
+    if (last_seq != NULL && header.seq != *last_seq) {
+      *last_seq = header.seq;
+      received = true;
+      if (header.opcode == PAWR_COMMAND_MOVE_SUBEVENT && last_seq == &last_command_seq && header.len >= 2U) {
+        move_pending = true;
+        move_subevent_id = data[i];
+        move_response_slot = data[i + 1U];
+      } else if (downlink_command_callback) {
+        downlink_command_callback(header.opcode, &data[i], header.len);
+      }
+    }
+    i += header.len;
+  }
+  return received;
+}
+
+
+// A newly provisioned node starts with the sequence numbers of the gateway
+static void peripheral_node_reset_commands()
+{
+  last_command_seq = PAWR_INVALID_COMMAND_SEQ;
+  last_broadcast_seq = PAWR_INVALID_COMMAND_SEQ;
+  move_pending = false;
+}
+
+
+// Listen to another subevent and answer in another slot. Every event is
+// received until the first beacon there tells its sync interval.
+static void peripheral_node_move_subevent(uint8_t subevent, uint8_t slot)
 {
   sl_status_t sc;
+  time_sync_handle.subevent_id = subevent;
+  time_sync_handle.response_slot = slot;
+  peripheral_node_set_interval_multiplier(1U);
+  sc = sl_bt_pawr_sync_set_sync_subevents(time_sync_handle.sync_handle,
+                                          sizeof(time_sync_handle.subevent_id),
+                                          &(time_sync_handle.subevent_id));
+  app_assert_status(sc);
+}
+
+
+// Answer in the own response slot, the gateway keeps track of the node by it.
+// The acknowledged command and the oldest queued uplink record go along with
+// the node ID.
+static void peripheral_node_send_response(sl_bt_msg_t* evt)
+{
+  sl_status_t sc;
+  uint8_t response[PAWR_UPLINK_HEADER_LENGTH + PAWR_UPLINK_MAX_PAYLOAD];
+  uint8_t len = PAWR_RESPONSE_LENGTH;
+  if (time_sync_handle.response_slot == INVALID_RESPONSE_SLOT) {
+    return;
+  }
+  response[0] = time_sync_handle.id;
+  response[1] = last_command_seq;
+  response[2] = (uint8_t)last_beacon_error;
+  response[3] = time_sync_handle.skip_factor;
+  if (uplink_queue_count > 0U) {
+    uplink_record_t *record = &uplink_queue[uplink_queue_head];
+    memcpy(&response[PAWR_RESPONSE_LENGTH], &record->timestamp, sizeof(record->timestamp));
+    memcpy(&response[PAWR_UPLINK_HEADER_LENGTH], record->data, record->len);
+    len = PAWR_UPLINK_HEADER_LENGTH + record->len;
+  }
+  sc = sl_bt_pawr_sync_set_response_data(time_sync_handle.sync_handle,
+                                         evt->data.evt_pawr_sync_subevent_report.event_counter,
+                                         evt->data.evt_pawr_sync_subevent_report.subevent,
+                                         evt->data.evt_pawr_sync_subevent_report.subevent,
+                                         time_sync_handle.response_slot,
+                                         len, response);
+  // the response slot may have passed already, the record waits for the next one then
+  if (sc == SL_STATUS_OK && len > PAWR_RESPONSE_LENGTH) {
+    uplink_queue_head = (uplink_queue_head + 1U) % PAWR_UPLINK_QUEUE_LENGTH;
+    uplink_queue_count--;
+  }
+}
+
+
+static void peripheral_node_bt_connection_closed()
+{
   // reset connection handle - before re-enabling advertising!
   time_sync_handle.connection_handle = SL_BT_INVALID_CONNECTION_HANDLE;
-  // Generate data for advertising
-  sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
-                                             sl_bt_advertiser_general_discoverable);
-  app_assert_status(sc);
+  // the gateway dropped the node during the timing exchange, the train it
+  // handed over is left and the closed event starts advertising again
+  if (timing_exchange_open) {
+    timing_exchange_open = false;
+    if (time_sync_handle.sync_handle != SL_BT_INVALID_SYNC_HANDLE) {
+      time_sync_handle.response_slot = INVALID_RESPONSE_SLOT;
+      (void)sl_bt_sync_close(time_sync_handle.sync_handle);
+      return;
+    }
+  }
+  // a synchronized node stays in the network without connection, any other
+  // is provisioned again and refuses a train handed over too late
+  if (time_sync_handle.sync_handle == SL_BT_INVALID_SYNC_HANDLE) {
+    time_sync_handle.response_slot = INVALID_RESPONSE_SLOT;
+    // Restart advertising after client has disconnected.
+    peripheral_node_start_advertising();
+  }
+}
 
-  // Restart advertising after client has disconnected.
-  sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
-                                     sl_bt_advertiser_connectable_scannable);
+
+static void peripheral_node_bt_sync_closed(uint16_t sync)
+{
+  // the scanner did not find the train again
+  if (sync == resync_handle) {
+    peripheral_node_stop_resync();
+    peripheral_node_rejoin();
+    return;
+  }
+  if (sync != time_sync_handle.sync_handle) {
+    return;
+  }
+  time_sync_handle.sync_handle = SL_BT_INVALID_SYNC_HANDLE;
+  (void)sl_sleeptimer_stop_timer(&subevent_timer);
+  // the clock holds over while the train is looked for, with or without
+  // connection, the gateway keeps the response slot for a few intervals
+  if (gateway_known && time_sync_handle.response_slot != INVALID_RESPONSE_SLOT) {
+    peripheral_node_start_resync();
+  } else {
+    peripheral_node_rejoin();
+  }
+}
+
+
+// The train is back without the gateway, the estimator keeps its state and
+// the next beacon is weighed against the holdover prediction
+static void peripheral_node_bt_sync_opened(sl_bt_msg_t* evt)
+{
+  sl_status_t sc;
+  if (evt->data.evt_pawr_sync_opened.sync != resync_handle) {
+    return;
+  }
+  peripheral_node_stop_resync();
+  time_sync_handle.sync_handle = evt->data.evt_pawr_sync_opened.sync;
+  // every event is received until the first beacon tells the sync interval
+  time_sync_handle.skip_factor = 1U;
+  subevent_late = false;
+  subevent_heard = false;
+  peripheral_node_set_interval_multiplier(1U);
+  peripheral_node_watch_subevent();
+  sc = sl_bt_pawr_sync_set_sync_subevents(time_sync_handle.sync_handle,
+                                           sizeof(time_sync_handle.subevent_id),
+                                           &(time_sync_handle.subevent_id));
   app_assert_status(sc);
 }
+
+
+// The gateway is about to drop the node, it has to be provisioned again.
+// A late subevent is looked for in every event until the next beacon tells
+// the sync interval.
+static void peripheral_node_bt_external_signal(uint32_t signals)
+{
+  if ((signals & PAWR_RESYNC_EXT_SIGNAL) && resync_handle != SL_BT_INVALID_SYNC_HANDLE) {
+    peripheral_node_abort_resync();
+  }
+  if ((signals & PAWR_SUBEVENT_EXT_SIGNAL) && time_sync_handle.sync_handle != SL_BT_INVALID_SYNC_HANDLE) {
+    if (!subevent_late && time_sync_handle.interval_multiplier * time_sync_handle.skip_factor > 1U) {
+      subevent_late = true;
+      time_sync_handle.skip_factor = 1U;
+      peripheral_node_update_sync_skip();
+      peripheral_node_watch_subevent();
+    } else if (time_sync_handle.connection_handle != SL_BT_INVALID_CONNECTION_HANDLE) {
+      peripheral_node_watch_subevent();
+    } else {
+      peripheral_node_close_train();
+    }
+  }
+}
+
+
+static void peripheral_node_start_resync()
+{
+  sl_status_t sc;
+  uint32_t timeout = PAWR_RESYNC_INTERVALS * time_sync_handle.pawr_interval_ticks;
+  sc = sl_bt_sync_scanner_set_sync_parameters(PAWR_SYNC_SKIP, PAWR_SYNC_MAX_TIMEOUT, sl_bt_sync_report_all);
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_scanner_start(sl_bt_scanner_scan_phy_1m, sl_bt_scanner_discover_observation);
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_sync_scanner_open(gateway_address, gateway_address_type, gateway_adv_sid, &resync_handle);
+    if (sc != SL_STATUS_OK) {
+      resync_handle = SL_BT_INVALID_SYNC_HANDLE;
+      (void)sl_bt_scanner_stop();
+    }
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_sleeptimer_start_timer(&resync_timer, timeout, resync_timer_callback, NULL, 0, 0);
+  }
+  if (sc != SL_STATUS_OK) {
+    peripheral_node_abort_resync();
+  }
+}
+
+
+// A sync still pending is closed, its closed event is not ours anymore
+static void peripheral_node_abort_resync()
+{
+  uint16_t sync = resync_handle;
+  peripheral_node_stop_resync();
+  if (sync != SL_BT_INVALID_SYNC_HANDLE) {
+    (void)sl_bt_sync_close(sync);
+  }
+  peripheral_node_rejoin();
+}
+
+
+static void peripheral_node_stop_resync()
+{
+  if (resync_handle != SL_BT_INVALID_SYNC_HANDLE) {
+    resync_handle = SL_BT_INVALID_SYNC_HANDLE;
+    (void)sl_bt_scanner_stop();
+  }
+  (void)sl_sleeptimer_stop_timer(&resync_timer);
+}
+
+
+// Ask the gateway for provisioning again. A connection still open is closed
+// first, the node advertises once it is gone.
+static void peripheral_node_rejoin()
+{
+  time_sync_handle.response_slot = INVALID_RESPONSE_SLOT;
+  if (time_sync_handle.connection_handle != SL_BT_INVALID_CONNECTION_HANDLE) {
+    (void)sl_bt_connection_close(time_sync_handle.connection_handle);
+  } else {
+    peripheral_node_start_advertising();
+  }
+}
+
+
+// The closed event of a silent train looks for it again. Silent right after
+// it was opened again, the gateway dropped the node.
+static void peripheral_node_close_train()
+{
+  if (!subevent_heard) {
+    time_sync_handle.response_slot = INVALID_RESPONSE_SLOT;
+  }
+  (void)sl_bt_sync_close(time_sync_handle.sync_handle);
+}
+
+
+// Runs in interrupt context, the timeout is handled in the event loop
+static void resync_timer_callback(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  sl_bt_external_signal(PAWR_RESYNC_EXT_SIGNAL);
+}
+
+
+// Runs in interrupt context as well
+static void subevent_timer_callback(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  sl_bt_external_signal(PAWR_SUBEVENT_EXT_SIGNAL);
+}
@@ -0,0 +1,494 @@
+/*
+ * bench_main.c
+ *
+ *  Sync-accuracy benchmark. Feeds a recorded or synthetic trace of PAwR
+ *  subevent arrivals to one copy of src/ble_time_sync_peripheral.c and
+ *  reports the offset error of get_timestamp() against the reference
+ *  (gateway) clock as JSON.
+ *
+ *  Trace format, one subevent arrival per line, '#' starts a comment:
+ *    local_tick,reference_tick,event_counter[,payload_hex[,radio_tick]]
+ *  local_tick is the peripheral sleeptimer when the report is processed,
+ *  reference_tick is the gateway sleeptimer at the same instant. radio_tick
+ *  is the peripheral sleeptimer at the arrival of the subevent at the radio,
+ *  it is latched into the SYSRTC capture before the report is processed, as
+ *  PAWR_RADIO_TIMESTAMP expects. 32-bit values are unwrapped. The local
+ *  columns are rebased onto the reference at the first arrival, so only the
+ *  tracking algorithm is measured.
+ *
+ *  The synthetic trace carries the radio column unless --radio 0 is given.
+ *  Without it the arrival is the processing time, whose mean latency the
+ *  beacons of the synthetic gateway then include, as a calibrated gateway
+ *  would, so the error left is the jitter around it.
+ *
+ *  The clock is set with a clock correction write at the first arrival, as
+ *  the timing exchange does, so later corrections are slewed and the reads
+ *  of get_timestamp64() that went back are counted.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ble_time_sync.h"
+#include "ble_time_sync_config.h"
+#include "gatt_db.h"
+#include "sim_metrics.h"
+#include "sim_nodes.h"
+#include "sim_stack.h"
+
+#define BENCH_NODE                      1U
+#define BENCH_MAX_PAYLOAD               64U
+#define TICKS_TO_US(t)                  ((double)(t) * 1e6 / SIM_TIMER_FREQUENCY)
+
+typedef struct bench_row_t {
+  uint64_t local_tick;
+  uint64_t reference_tick;
+  uint64_t radio_tick;
+  uint16_t event_counter;
+  uint8_t  payload_len;
+  uint8_t  payload[BENCH_MAX_PAYLOAD];
+} bench_row_t;
+
+typedef struct bench_trace_t {
+  bench_row_t *rows;
+  size_t       count;
+  size_t       capacity;
+  uint32_t     lost;
+} bench_trace_t;
+
+typedef struct bench_options_t {
+  const char *trace_path;
+  const char *write_trace_path;
+  double      interval_ms;
+  double      duration_s;
+  double      ppm;
+  double      gw_ppm;
+  double      latency_us;
+  double      jitter_us;
+  double      loss;
+  double      initial_error_us;
+  double      converge_us;
+  double      step_us;
+  double      step_at_s;
+  uint32_t    settle;
+  uint32_t    samples_per_interval;
+  uint32_t    seed;
+  int         radio;
+  peripheral_node_config_t node;
+} bench_options_t;
+
+static bench_options_t options = {
+  .interval_ms = PAWR_INTERVAL_MS * PAWR_MAX_INTERVAL_MULTIPLIER,
+  .duration_s = 3600.0,
+  .ppm = 20.0,
+  .latency_us = 200.0,
+  .jitter_us = 2000.0,
+  .converge_us = 100.0,
+  .settle = 5,
+  .samples_per_interval = 4,
+  .seed = 1,
+  .radio = PAWR_RADIO_TIMESTAMP,
+  .node = { .arrival_noise_us = PAWR_ARRIVAL_NOISE_US, .skew_noise_ppb = PAWR_SKEW_NOISE_PPB,
+            .skip_accuracy_us = PAWR_SKIP_ACCURACY_US, .slew_window_ms = PAWR_SLEW_WINDOW_MS,
+            .slew_max_ppm = PAWR_SLEW_MAX_PPM },
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --trace FILE            replay a recorded trace instead of a synthetic one\n"
+          "  --write-trace FILE      save the synthetic trace\n"
+          "  --interval-ms I         sync interval (default PAWR_INTERVAL_MS *\n"
+          "                          PAWR_MAX_INTERVAL_MULTIPLIER = %d ms)\n"
+          "  --duration S            synthetic trace length in seconds (default 3600)\n"
+          "  --ppm P                 peripheral crystal error (default 20)\n"
+          "  --gw-ppm P              gateway sleeptimer error vs. the radio clock (default 0)\n"
+          "  --latency-us L          report processing latency (default 200)\n"
+          "  --jitter-us J           uniform latency jitter (default 2000)\n"
+          "  --radio 0|1             synthetic trace carries the arrival at the radio\n"
+          "                          (default PAWR_RADIO_TIMESTAMP = %d)\n"
+          "  --loss P                subevent loss rate (default 0)\n"
+          "  --initial-error-us E    offset error at the first arrival (default 0)\n"
+          "  --step-us S@T           gateway time steps by S us after T seconds (default none)\n"
+          "  --converge-us E         convergence threshold (default 100)\n"
+          "  --settle N              arrivals within threshold to count as converged (default 5)\n"
+          "  --samples-per-interval M  error samples between arrivals (default 4)\n"
+          "  --seed X                random seed (default 1)\n"
+          "  --arrival-noise-us N    arrival noise assumed by the peripheral (default %d)\n"
+          "  --skew-noise-ppb Q      skew random walk assumed by the peripheral (default %d)\n",
+          prog, PAWR_INTERVAL_MS * PAWR_MAX_INTERVAL_MULTIPLIER, PAWR_RADIO_TIMESTAMP, PAWR_ARRIVAL_NOISE_US,
+          PAWR_SKEW_NOISE_PPB);
+}
+
+static void parse_options(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    const char *val = (i + 1 < argc) ? argv[++i] : NULL;
+    if (val == NULL) {
+      usage(argv[0]);
+      exit(2);
+    }
+    if (strcmp(opt, "--trace") == 0) {
+      options.trace_path = val;
+    } else if (strcmp(opt, "--write-trace") == 0) {
+      options.write_trace_path = val;
+    } else if (strcmp(opt, "--interval-ms") == 0) {
+      options.interval_ms = atof(val);
+    } else if (strcmp(opt, "--duration") == 0) {
+      options.duration_s = atof(val);
+    } else if (strcmp(opt, "--ppm") == 0) {
+      options.ppm = atof(val);
+    } else if (strcmp(opt, "--gw-ppm") == 0) {
+      options.gw_ppm = atof(val);
+    } else if (strcmp(opt, "--latency-us") == 0) {
+      options.latency_us = atof(val);
+    } else if (strcmp(opt, "--jitter-us") == 0) {
+      options.jitter_us = atof(val);
+    } else if (strcmp(opt, "--radio") == 0) {
+      options.radio = atoi(val);
+    } else if (strcmp(opt, "--loss") == 0) {
+      options.loss = atof(val);
+    } else if (strcmp(opt, "--initial-error-us") == 0) {
+      options.initial_error_us = atof(val);
+    } else if (strcmp(opt, "--step-us") == 0) {
+      if (sscanf(val, "%lf@%lf", &options.step_us, &options.step_at_s) != 2) {
+        usage(argv[0]);
+        exit(2);
+      }
+    } else if (strcmp(opt, "--converge-us") == 0) {
+      options.converge_us = atof(val);
+    } else if (strcmp(opt, "--settle") == 0) {
+      options.settle = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--samples-per-interval") == 0) {
+      options.samples_per_interval = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--seed") == 0) {
+      options.seed = (uint32_t)strtoul(val, NULL, 0);
+    } else if (strcmp(opt, "--arrival-noise-us") == 0) {
+      options.node.arrival_noise_us = (uint16_t)atoi(val);
+    } else if (strcmp(opt, "--skew-noise-ppb") == 0) {
+      options.node.skew_noise_ppb = (uint16_t)atoi(val);
+    } else {
+      usage(argv[0]);
+      exit(2);
+    }
+  }
+  if (options.interval_ms < 7.5 || options.samples_per_interval == 0) {
+    usage(argv[0]);
+    exit(2);
+  }
+}
+
+static bench_row_t *trace_append(bench_trace_t *trace)
+{
+  if (trace->count == trace->capacity) {
+    trace->capacity = trace->capacity ? trace->capacity * 2 : 1024;
+    trace->rows = realloc(trace->rows, trace->capacity * sizeof(bench_row_t));
+    if (trace->rows == NULL) {
+      abort();
+    }
+  }
+  bench_row_t *row = &trace->rows[trace->count++];
+  memset(row, 0, sizeof(*row));
+  return row;
+}
+
+static uint64_t unwrap(uint64_t value, uint64_t previous)
+{
+  if (value > UINT32_MAX) {
+    return value;
+  }
+  uint64_t candidate = (previous & ~(uint64_t)UINT32_MAX) | value;
+  if (candidate + 0x80000000ULL < previous) {
+    candidate += 0x100000000ULL;
+  } else if (candidate > previous + 0x80000000ULL && candidate >= 0x100000000ULL) {
+    candidate -= 0x100000000ULL;
+  }
+  return candidate;
+}
+
+static void load_trace(const char *path, bench_trace_t *trace)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    unsigned long long local, reference, radio;
+    unsigned counter;
+    char payload[2 * BENCH_MAX_PAYLOAD + 1] = { 0 };
+    int fields = sscanf(line, "%llu,%llu,%u,%128[0-9a-fA-F],%llu", &local, &reference, &counter, payload, &radio);
+    if (fields < 3) {
+      fprintf(stderr, "%s: malformed line: %s", path, line);
+      exit(1);
+    }
+    bench_row_t *row = trace_append(trace);
+    const bench_row_t *prev = (trace->count > 1) ? row - 1 : NULL;
+    row->local_tick = prev ? unwrap(local, prev->local_tick) : local;
+    row->reference_tick = prev ? unwrap(reference, prev->reference_tick) : reference;
+    if (fields == 5) {
+      row->radio_tick = unwrap(radio, row->local_tick);
+    }
+    row->event_counter = (uint16_t)counter;
+    for (size_t i = 0; fields >= 4 && payload[2 * i] && payload[2 * i + 1]; i++) {
+      unsigned byte;
+      sscanf(&payload[2 * i], "%2x", &byte);
+      row->payload[row->payload_len++] = (uint8_t)byte;
+    }
+    if (prev) {
+      trace->lost += (uint16_t)(row->event_counter - prev->event_counter - 1U);
+    }
+  }
+  fclose(f);
+}
+
+static void generate_trace(bench_trace_t *trace)
+{
+  const double f = SIM_TIMER_FREQUENCY;
+  const double interval_s = options.interval_ms / 1000.0;
+  const uint64_t base = 0x00100000ULL;
+  uint64_t events = (uint64_t)(options.duration_s / interval_s);
+  for (uint64_t k = 1; k <= events; k++) {
+    if (sim_random_unit() < options.loss) {
+      trace->lost++;
+      continue;
+    }
+    double t = k * interval_s + (options.latency_us + sim_random_unit() * options.jitter_us) * 1e-6;
+    // a step of the gateway time moves the reference and its beacons alike
+    double step = (options.step_us != 0.0 && k * interval_s >= options.step_at_s) ? options.step_us * 1e-6 : 0.0;
+    bench_row_t *row = trace_append(trace);
+    row->local_tick = base + (uint64_t)(t * f * (1.0 + options.ppm * 1e-6));
+    row->reference_tick = base + (uint64_t)((t * (1.0 + options.gw_ppm * 1e-6) + step) * f);
+    row->event_counter = (uint16_t)k;
+    // the gateway stamps the transmission time of the subevent, the arrival
+    // the peripheral sees: at the radio, or after the mean processing latency
+    double arrival = k * interval_s;
+    if (options.radio) {
+      row->radio_tick = base + (uint64_t)(arrival * f * (1.0 + options.ppm * 1e-6));
+    } else {
+      arrival += (options.latency_us + options.jitter_us / 2.0) * 1e-6;
+    }
+    uint64_t transmission = base + (uint64_t)((arrival * (1.0 + options.gw_ppm * 1e-6) + step) * f);
+    pawr_time_beacon_t beacon = {
+      .epoch = (uint8_t)(transmission >> 32),
+      .gateway_tick = (uint32_t)transmission,
+      .interval_multiplier = 1U
+    };
+    memcpy(row->payload, &beacon, sizeof(beacon));
+    row->payload_len = sizeof(beacon);
+  }
+}
+
+static void write_trace(const char *path, const bench_trace_t *trace)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fprintf(f, "# local_tick,reference_tick,event_counter[,payload_hex[,radio_tick]]\n");
+  for (size_t i = 0; i < trace->count; i++) {
+    const bench_row_t *row = &trace->rows[i];
+    fprintf(f, "%llu,%llu,%u", (unsigned long long)row->local_tick,
+            (unsigned long long)row->reference_tick, row->event_counter);
+    if (row->payload_len) {
+      fputc(',', f);
+      for (uint8_t b = 0; b < row->payload_len; b++) {
+        fprintf(f, "%02x", row->payload[b]);
+      }
+      if (row->radio_tick) {
+        fprintf(f, ",%llu", (unsigned long long)row->radio_tick);
+      }
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+}
+
+static void deliver(uint64_t local_tick, sl_bt_msg_t *msg)
+{
+  sim_node_override_tick(BENCH_NODE, true, local_tick);
+  sim_peripheral_entries[BENCH_NODE - 1].on_bt_event(msg);
+}
+
+static double offset_error_us(uint64_t local_tick, uint64_t reference_tick)
+{
+  sim_node_override_tick(BENCH_NODE, true, local_tick);
+  uint32_t timestamp = sim_peripheral_entries[BENCH_NODE - 1].get_timestamp();
+  return TICKS_TO_US((int32_t)(timestamp - (uint32_t)reference_tick));
+}
+
+static void start_sync(const bench_row_t *first, uint16_t interval_units)
+{
+  sl_bt_msg_t msg = { .header = sl_bt_evt_system_boot_id };
+  deliver(first->local_tick, &msg);
+
+  sim_node_force_sync(BENCH_NODE);
+  memset(&msg, 0, sizeof(msg));
+  msg.header = sl_bt_evt_pawr_sync_transfer_received_id;
+  msg.data.evt_pawr_sync_transfer_received.status = SL_STATUS_OK;
+  msg.data.evt_pawr_sync_transfer_received.sync = 1;
+  msg.data.evt_pawr_sync_transfer_received.adv_interval = interval_units;
+  msg.data.evt_pawr_sync_transfer_received.num_subevents = 1;
+  // the sync is established one periodic event before the first report
+  uint32_t interval_ticks = (uint32_t)((uint64_t)interval_units * 1250U * SIM_TIMER_FREQUENCY / 1000000U);
+  deliver(first->local_tick - interval_ticks, &msg);
+}
+
+static void deliver_report(const bench_row_t *row)
+{
+  sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_sync_subevent_report_id };
+  sl_bt_evt_pawr_sync_subevent_report_t *rep = &msg.data.evt_pawr_sync_subevent_report;
+  rep->sync = 1;
+  rep->event_counter = row->event_counter;
+  rep->data_status = 0;
+  rep->data.len = row->payload_len;
+  memcpy(rep->data.data, row->payload, row->payload_len);
+  if (row->radio_tick) {
+    sim_node_capture(BENCH_NODE, row->radio_tick);
+  }
+  deliver(row->local_tick, &msg);
+}
+
+// A correction of 0 in the format of older gateways sets the clock without
+// moving it
+static void set_clock(const bench_row_t *row)
+{
+  sl_bt_msg_t msg = { .header = sl_bt_evt_gatt_server_user_write_request_id };
+  sl_bt_evt_gatt_server_user_write_request_t *req = &msg.data.evt_gatt_server_user_write_request;
+  req->characteristic = gattdb_clock_correction;
+  req->att_opcode = sl_bt_gatt_write_command;
+  req->value.len = sizeof(uint32_t);
+  memset(req->value.data, 0, sizeof(uint32_t));
+  deliver(row->local_tick, &msg);
+}
+
+// Counts the reads of the presented time that went back
+static uint32_t backward_steps = 0U;
+static uint64_t last_timestamp = 0U;
+
+static void check_monotonic(uint64_t local_tick)
+{
+  sim_node_override_tick(BENCH_NODE, true, local_tick);
+  uint64_t timestamp = sim_peripheral_entries[BENCH_NODE - 1].get_timestamp64();
+  if (timestamp < last_timestamp) {
+    backward_steps++;
+  }
+  last_timestamp = timestamp;
+}
+
+int main(int argc, char **argv)
+{
+  parse_options(argc, argv);
+  sim_config_t config = { .num_peripherals = 1, .seed = options.seed, .conn_interval_us = 30000 };
+  sim_init(&config);
+  sim_set_current_node(BENCH_NODE);
+  if (sim_peripheral_entries[BENCH_NODE - 1].init(&options.node) != SL_STATUS_OK) {
+    fprintf(stderr, "invalid peripheral configuration\n");
+    return 2;
+  }
+
+  bench_trace_t trace = { 0 };
+  if (options.trace_path) {
+    load_trace(options.trace_path, &trace);
+  } else {
+    generate_trace(&trace);
+  }
+  if (trace.count < 2) {
+    fprintf(stderr, "trace has fewer than two arrivals\n");
+    return 1;
+  }
+  if (options.write_trace_path) {
+    write_trace(options.write_trace_path, &trace);
+  }
+
+  // rebase the local clock onto the reference at the first arrival
+  int64_t initial_error = (int64_t)llround(options.initial_error_us * SIM_TIMER_FREQUENCY / 1e6);
+  int64_t rebase = (int64_t)(trace.rows[0].reference_tick - trace.rows[0].local_tick) + initial_error;
+  for (size_t i = 0; i < trace.count; i++) {
+    trace.rows[i].local_tick += (uint64_t)rebase;
+    if (trace.rows[i].radio_tick) {
+      trace.rows[i].radio_tick += (uint64_t)rebase;
+    }
+  }
+
+  uint16_t interval_units = (uint16_t)lround(options.interval_ms / 1.25);
+  start_sync(&trace.rows[0], interval_units);
+
+  sim_series_t errors = { 0 };
+  sim_series_t times = { 0 };
+  sim_series_t arrival_errors = { 0 };
+  deliver_report(&trace.rows[0]);
+  set_clock(&trace.rows[0]);
+  check_monotonic(trace.rows[0].local_tick);
+  for (size_t i = 1; i < trace.count; i++) {
+    const bench_row_t *prev = &trace.rows[i - 1];
+    const bench_row_t *row = &trace.rows[i];
+    for (uint32_t j = 1; j <= options.samples_per_interval; j++) {
+      double a = (double)j / options.samples_per_interval;
+      uint64_t local = prev->local_tick + (uint64_t)(a * (double)(row->local_tick - prev->local_tick));
+      uint64_t reference = prev->reference_tick + (uint64_t)(a * (double)(row->reference_tick - prev->reference_tick));
+      sim_series_push(&errors, offset_error_us(local, reference));
+      check_monotonic(local);
+      sim_series_push(&times, (double)(reference - trace.rows[0].reference_tick) / SIM_TIMER_FREQUENCY);
+    }
+    // error accumulated over the interval, right before the correction
+    sim_series_push(&arrival_errors, errors.values[errors.count - 1]);
+    deliver_report(row);
+    check_monotonic(row->local_tick);
+  }
+
+  // converged once `settle` consecutive arrivals stay within the threshold
+  double time_to_converge = -1.0;
+  size_t steady_from = 0;
+  uint32_t in_band = 0;
+  for (size_t i = 0; i < arrival_errors.count; i++) {
+    in_band = (fabs(arrival_errors.values[i]) <= options.converge_us) ? in_band + 1 : 0;
+    if (in_band >= options.settle) {
+      size_t first = (i + 1 - in_band) * options.samples_per_interval;
+      time_to_converge = times.values[first];
+      steady_from = first;
+      break;
+    }
+  }
+  double worst_excursion = 0.0;
+  for (size_t i = steady_from; i < errors.count; i++) {
+    if (fabs(errors.values[i]) > worst_excursion) {
+      worst_excursion = fabs(errors.values[i]);
+    }
+  }
+  sim_error_stats_t all, steady;
+  sim_error_stats(errors.values, errors.count, &all);
+  sim_error_stats(errors.values + steady_from, errors.count - steady_from, &steady);
+
+  printf("{\n  \"trace\": \"%s\",\n", options.trace_path ? options.trace_path : "synthetic");
+  printf("  \"interval_ms\": %.2f, \"arrivals\": %zu, \"lost\": %u,\n",
+         options.interval_ms, trace.count, trace.lost);
+  if (!options.trace_path) {
+    printf("  \"ppm\": %.3f, \"gw_ppm\": %.3f, \"latency_us\": %.1f, \"jitter_us\": %.1f, \"loss\": %.4f, \"radio\": %d,\n",
+           options.ppm, options.gw_ppm, options.latency_us, options.jitter_us, options.loss, options.radio ? 1 : 0);
+  }
+  printf("  \"converge_threshold_us\": %.1f, \"time_to_converge_s\": %.3f, \"worst_excursion_us\": %.3f,\n",
+         options.converge_us, time_to_converge, worst_excursion);
+  printf("  \"backward_steps\": %u,\n", backward_steps);
+  printf("  ");
+  sim_error_stats_json(stdout, "offset_error", &all);
+  printf(",\n  ");
+  sim_error_stats_json(stdout, "steady_state_error", &steady);
+  printf("\n}\n");
+
+  sim_series_free(&errors);
+  sim_series_free(&times);
+  sim_series_free(&arrival_errors);
+  free(trace.rows);
+  return 0;
+}
@@ -0,0 +1,559 @@
+/*
+ * sim_main.c
+ *
+ *  Host simulator of a BLE Time Sync network: one gateway running
+ *  src/ble_time_sync_gateway.c and N peripherals running
+ *  src/ble_time_sync_peripheral.c on top of the simulated stack. The
+ *  synchronized time of every peripheral is sampled against the gateway
+ *  sleeptimer, which is the reference the protocol distributes.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ble_time_sync.h"
+#include "sim_metrics.h"
+#include "sim_nodes.h"
+#include "sim_stack.h"
+
+#define TICKS_TO_US(t)                  ((double)(t) * 1e6 / SIM_TIMER_FREQUENCY)
+#define SIM_COMMAND_UNICAST             0x01U
+#define SIM_COMMAND_BROADCAST           0x02U
+
+typedef struct sim_options_t {
+  sim_config_t config;
+  double       duration_s;
+  double       ppm_spread;
+  uint32_t     sample_ms;
+  double       converge_us;
+  double       uplink_s;
+  double       command_s;
+  bool         app_service;
+  bool         json;
+  ble_time_sync_config_t sync;
+} sim_options_t;
+
+typedef struct sim_node_report_t {
+  sim_series_t samples;         // offset error in microseconds
+  sim_series_t sample_times;    // virtual time of each sample in seconds
+  double       convergence_s;
+  sim_error_stats_t steady;
+  uint32_t     backward_steps;  // events after which the synchronized time was earlier
+} sim_node_report_t;
+
+static sim_options_t     options;
+static sim_node_report_t reports[SIM_MAX_PERIPHERALS];
+static uint32_t          sync_ready_count = 0;
+static uint32_t          app_service_resolved = 0;
+// Clock error of each node right after its timing exchange, in microseconds
+static sim_series_t      exchange_errors;
+// "Audio Streaming" service of the peripheral GATT database
+static const app_service_t audio_stream_service = {
+  .service_uuid = { 0xCBU, 0x95U },
+  .num_characteristics = 1,
+  .characteristic_uuids = { { 0x6BU, 0x97U } }
+};
+static bool              node_left[SIM_MAX_PERIPHERALS];
+// First completion of the timing exchange of each node, its clock is set from then on
+static uint64_t          ready_ns[SIM_MAX_PERIPHERALS];
+static uint32_t          uplink_sent = 0;
+static uint32_t          uplink_received = 0;
+static double            uplink_age_sum_ms = 0.0;
+// Downlink commands, the queueing time is kept per node ID and sequence number
+static uint64_t          command_queued_ns[UINT8_MAX + 1][UINT8_MAX + 1];
+static uint32_t          commands_queued = 0;
+static uint32_t          commands_acked = 0;
+static uint32_t          commands_failed = 0;
+static uint32_t          commands_run = 0;
+static uint32_t          broadcasts_queued = 0;
+static uint32_t          broadcasts_run = 0;
+static double            command_latency_sum_ms = 0.0;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --nodes N            number of peripherals (1..%d, default 4)\n"
+          "  --duration S         virtual seconds to simulate (default 120)\n"
+          "  --seed X             random seed (default 1)\n"
+          "  --ppm-spread P       peripheral crystal error drawn from [-P, P] ppm (default 20)\n"
+          "  --ppm P1,P2,...      explicit peripheral crystal errors in ppm\n"
+          "  --gw-ppm P           gateway crystal error in ppm (default 0)\n"
+          "  --latency-us L       peripheral event-delivery latency (default 200)\n"
+          "  --jitter-us J        peripheral latency jitter, uniform (default 2000)\n"
+          "  --gw-latency-us L    gateway event-delivery latency (default 200)\n"
+          "  --gw-jitter-us J     gateway latency jitter, uniform (default 2000)\n"
+          "  --loss P             PAwR packet error rate (default 0)\n"
+          "  --conn-interval-ms C connection interval (default 30)\n"
+          "  --pawr-lead-ms L     subevent data request lead time (default 10)\n"
+          "  --tick-base T        sleeptimer ticks at boot, e.g. 0xfff00000 to wrap the\n"
+          "                       32-bit tick early, below 2^40 as the beacon carries\n"
+          "                       40 bits of the gateway time (default 0)\n"
+          "  --pawr-interval-ms I PAwR train interval (default PAWR_INTERVAL_MS)\n"
+          "  --max-multiplier M   longest sync interval in PAwR intervals\n"
+          "                       (default PAWR_MAX_INTERVAL_MULTIPLIER)\n"
+          "  --accuracy-us A      sync accuracy of the interval control (default PAWR_SYNC_ACCURACY_US)\n"
+          "  --sample-ms T        offset sampling period (default 50)\n"
+          "  --converge-us E      convergence threshold (default 100)\n"
+          "  --leave N@S,...      power peripheral N off at S seconds\n"
+          "  --drop-sync N@S,...  peripheral N loses its PAwR sync at S seconds and rejoins\n"
+          "  --uplink-s T         every peripheral queues an uplink record every T seconds\n"
+          "  --command-s T        the gateway queues a command for every node and a broadcast\n"
+          "                       command every T seconds\n"
+          "  --log-level N        library log level, 0..4 (default 0)\n"
+          "  --app-service        resolve the audio streaming service during onboarding\n"
+          "  --json               print the report as JSON\n",
+          prog, SIM_MAX_PERIPHERALS);
+}
+
+static void parse_ppm_list(const char *list)
+{
+  char *copy = strdup(list);
+  char *save = NULL;
+  uint8_t i = 0;
+  for (char *tok = strtok_r(copy, ",", &save); tok && i < SIM_MAX_PERIPHERALS;
+       tok = strtok_r(NULL, ",", &save)) {
+    options.config.peripherals[i++].ppm = atof(tok);
+  }
+  free(copy);
+}
+
+static void node_leave(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  node_left[node - 1] = true;
+  sim_node_leave(node);
+}
+
+static void node_drop_sync(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  sim_node_drop_sync(node);
+}
+
+static void parse_event_list(const char *list, sim_call_t fn)
+{
+  char *copy = strdup(list);
+  char *save = NULL;
+  for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    unsigned node;
+    double at_s;
+    if (sscanf(tok, "%u@%lf", &node, &at_s) == 2 && node >= 1 && node <= options.config.num_peripherals) {
+      sim_call_at((uint64_t)(at_s * SIM_NS_PER_S), (uint8_t)node, fn, 0);
+    }
+  }
+  free(copy);
+}
+
+static void parse_options(int argc, char **argv, const char **leave_list, const char **drop_list)
+{
+  sim_config_t *cfg = &options.config;
+  const char *ppm_list = NULL;
+  cfg->num_peripherals = 4;
+  cfg->seed = 1;
+  cfg->conn_interval_us = 30000;
+  cfg->pawr_lead_us = 10000;
+  cfg->gateway.latency_us = 200;
+  cfg->gateway.jitter_us = 2000;
+  options.duration_s = 120.0;
+  options.ppm_spread = 20.0;
+  options.sample_ms = 50;
+  options.converge_us = 100.0;
+  uint32_t latency_us = 200;
+  uint32_t jitter_us = 2000;
+  ble_time_sync_get_default_config(&options.sync);
+
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (strcmp(opt, "--json") == 0) {
+      options.json = true;
+      continue;
+    }
+    if (strcmp(opt, "--app-service") == 0) {
+      options.app_service = true;
+      continue;
+    }
+    if (val == NULL) {
+      usage(argv[0]);
+      exit(2);
+    }
+    i++;
+    if (strcmp(opt, "--nodes") == 0) {
+      cfg->num_peripherals = (uint8_t)atoi(val);
+    } else if (strcmp(opt, "--duration") == 0) {
+      options.duration_s = atof(val);
+    } else if (strcmp(opt, "--seed") == 0) {
+      cfg->seed = (uint32_t)strtoul(val, NULL, 0);
+    } else if (strcmp(opt, "--ppm-spread") == 0) {
+      options.ppm_spread = atof(val);
+    } else if (strcmp(opt, "--ppm") == 0) {
+      ppm_list = val;
+    } else if (strcmp(opt, "--gw-ppm") == 0) {
+      cfg->gateway.ppm = atof(val);
+    } else if (strcmp(opt, "--latency-us") == 0) {
+      latency_us = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--jitter-us") == 0) {
+      jitter_us = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--gw-latency-us") == 0) {
+      cfg->gateway.latency_us = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--gw-jitter-us") == 0) {
+      cfg->gateway.jitter_us = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--loss") == 0) {
+      cfg->loss = atof(val);
+    } else if (strcmp(opt, "--conn-interval-ms") == 0) {
+      cfg->conn_interval_us = (uint32_t)(atof(val) * 1000.0);
+    } else if (strcmp(opt, "--pawr-lead-ms") == 0) {
+      cfg->pawr_lead_us = (uint32_t)(atof(val) * 1000.0);
+    } else if (strcmp(opt, "--tick-base") == 0) {
+      cfg->tick_base = strtoull(val, NULL, 0);
+    } else if (strcmp(opt, "--pawr-interval-ms") == 0) {
+      options.sync.pawr_interval_ms = (uint16_t)atoi(val);
+    } else if (strcmp(opt, "--max-multiplier") == 0) {
+      options.sync.max_interval_multiplier = (uint8_t)atoi(val);
+    } else if (strcmp(opt, "--accuracy-us") == 0) {
+      options.sync.sync_accuracy_us = (uint16_t)atoi(val);
+    } else if (strcmp(opt, "--sample-ms") == 0) {
+      options.sample_ms = (uint32_t)atoi(val);
+    } else if (strcmp(opt, "--converge-us") == 0) {
+      options.converge_us = atof(val);
+    } else if (strcmp(opt, "--leave") == 0) {
+      *leave_list = val;
+    } else if (strcmp(opt, "--drop-sync") == 0) {
+      *drop_list = val;
+    } else if (strcmp(opt, "--uplink-s") == 0) {
+      options.uplink_s = atof(val);
+    } else if (strcmp(opt, "--command-s") == 0) {
+      options.command_s = atof(val);
+    } else if (strcmp(opt, "--log-level") == 0) {
+      cfg->log_level = atoi(val);
+    } else {
+      usage(argv[0]);
+      exit(2);
+    }
+  }
+  if (cfg->num_peripherals == 0 || cfg->num_peripherals > SIM_MAX_PERIPHERALS
+      || options.sample_ms == 0 || cfg->conn_interval_us < 7500) {
+    usage(argv[0]);
+    exit(2);
+  }
+
+  // draw the crystal errors before the simulator reseeds its generator
+  srand(cfg->seed);
+  for (uint8_t i = 0; i < cfg->num_peripherals; i++) {
+    sim_node_config_t *pn = &cfg->peripherals[i];
+    pn->ppm = options.ppm_spread * (2.0 * rand() / (double)RAND_MAX - 1.0);
+    pn->latency_us = latency_us;
+    pn->jitter_us = jitter_us;
+    pn->boot_ms = 50U + (uint32_t)(rand() % 500);
+  }
+  if (ppm_list) {
+    parse_ppm_list(ppm_list);
+  }
+}
+
+// A node is onboarded once it has both the train and a clock set by the
+// timing exchange, the gateway hands the train over during the exchange
+static uint64_t onboarded_ns(uint8_t node)
+{
+  uint64_t synced = sim_node_stats(node)->synced_ns;
+  if (!synced || !ready_ns[node - 1]) {
+    return 0;
+  }
+  return (synced > ready_ns[node - 1]) ? synced : ready_ns[node - 1];
+}
+
+static void sample_offsets(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  uint64_t gateway_tick = sim_node_tick64(SIM_GATEWAY_NODE);
+  for (uint8_t i = 1; i <= options.config.num_peripherals; i++) {
+    if (!onboarded_ns(i) || node_left[i - 1]) {
+      continue;
+    }
+    sim_set_current_node(i);
+    int64_t error_ticks = (int64_t)(sim_peripheral_entries[i - 1].get_timestamp64() - gateway_tick);
+    sim_set_current_node(SIM_GATEWAY_NODE);
+    sim_series_push(&reports[i - 1].samples, TICKS_TO_US(error_ticks));
+    sim_series_push(&reports[i - 1].sample_times, (double)sim_now_ns() / SIM_NS_PER_S);
+  }
+  sim_call_at(sim_now_ns() + arg, SIM_GATEWAY_NODE, sample_offsets, arg);
+}
+
+// Queue a record holding the simulator node number once the node is synced
+static void send_uplink(uint8_t node, uint64_t arg)
+{
+  if (node_left[node - 1]) {
+    return;
+  }
+  if (onboarded_ns(node)) {
+    uint8_t record[3] = { node, (uint8_t)arg, (uint8_t)(arg >> 8) };
+    if (sim_peripheral_entries[node - 1].send_uplink_data(record, sizeof(record)) == SL_STATUS_OK) {
+      uplink_sent++;
+      arg++;
+    }
+  }
+  sim_call_at(sim_now_ns() + (uint64_t)(options.uplink_s * SIM_NS_PER_S), node, send_uplink, arg);
+}
+
+static void uplink_data(uint8_t node_id, uint32_t timestamp, const uint8_t *data, uint8_t len)
+{
+  (void)node_id;
+  (void)data;
+  (void)len;
+  uint32_t gateway_tick = (uint32_t)sim_node_tick64(SIM_GATEWAY_NODE);
+  uplink_received++;
+  uplink_age_sum_ms += TICKS_TO_US((int32_t)(gateway_tick - timestamp)) / 1000.0;
+}
+
+static void send_commands(uint8_t node, uint64_t arg)
+{
+  uint8_t seq;
+  for (uint16_t id = 0; id < PAWR_BROADCAST_NODE_ID; id++) {
+    if (ble_time_sync_send_command((uint8_t)id, SIM_COMMAND_UNICAST, NULL, 0, &seq) == SL_STATUS_OK) {
+      command_queued_ns[id][seq] = sim_now_ns();
+      commands_queued++;
+    }
+  }
+  if (ble_time_sync_send_command(PAWR_BROADCAST_NODE_ID, SIM_COMMAND_BROADCAST, NULL, 0, NULL) == SL_STATUS_OK) {
+    broadcasts_queued++;
+  }
+  sim_call_at(sim_now_ns() + arg, node, send_commands, arg);
+}
+
+static void command_status(uint8_t node_id, uint8_t seq, sl_status_t status)
+{
+  if (node_id == PAWR_BROADCAST_NODE_ID) {
+    return;
+  }
+  if (status == SL_STATUS_OK) {
+    commands_acked++;
+    command_latency_sum_ms += (double)(sim_now_ns() - command_queued_ns[node_id][seq]) / SIM_NS_PER_MS;
+  } else {
+    commands_failed++;
+  }
+}
+
+static void command_received(uint8_t opcode, const uint8_t *data, uint8_t len)
+{
+  (void)data;
+  (void)len;
+  if (opcode == SIM_COMMAND_BROADCAST) {
+    broadcasts_run++;
+  } else {
+    commands_run++;
+  }
+}
+
+// A synchronized peripheral's time must not go back across the handling of an event
+static void peripheral_event(sl_bt_msg_t *evt)
+{
+  uint8_t i = sim_current_node();
+  uint64_t before = sim_peripheral_entries[i - 1].get_timestamp64();
+  sim_peripheral_entries[i - 1].on_bt_event(evt);
+  if (onboarded_ns(i) && sim_peripheral_entries[i - 1].get_timestamp64() < before) {
+    reports[i - 1].backward_steps++;
+  }
+}
+
+static void sync_ready(uint8_t connection_handle)
+{
+  const peripheral_node_t *node = get_peripheral_node(connection_handle);
+  sync_ready_count++;
+  uint8_t pn = sim_connection_peripheral(connection_handle);
+  if (pn != SIM_GATEWAY_NODE) {
+    if (!ready_ns[pn - 1]) {
+      ready_ns[pn - 1] = sim_now_ns();
+    }
+    uint64_t gateway_tick = sim_node_tick64(SIM_GATEWAY_NODE);
+    sim_set_current_node(pn);
+    int64_t error_ticks = (int64_t)(sim_peripheral_entries[pn - 1].get_timestamp64() - gateway_tick);
+    sim_set_current_node(SIM_GATEWAY_NODE);
+    sim_series_push(&exchange_errors, TICKS_TO_US(error_ticks));
+  }
+  if (options.app_service && node && node->app_characteristic_handles[0][0] != INVALID_NODE_CHAR_HANDLE) {
+    app_service_resolved++;
+  }
+}
+
+static void evaluate_node(uint8_t i)
+{
+  sim_node_report_t *r = &reports[i - 1];
+  size_t first_steady = r->samples.count;
+  r->convergence_s = -1.0;
+  // converged from the first sample after which the error stays in bounds
+  while (first_steady > 0 && fabs(r->samples.values[first_steady - 1]) <= options.converge_us) {
+    first_steady--;
+  }
+  if (first_steady < r->samples.count) {
+    r->convergence_s = r->sample_times.values[first_steady] - (double)onboarded_ns(i) / SIM_NS_PER_S;
+  } else {
+    first_steady = 0;
+  }
+  sim_error_stats(r->samples.values + first_steady, r->samples.count - first_steady, &r->steady);
+}
+
+static void print_text_report(void)
+{
+  const sim_config_t *cfg = &options.config;
+  printf("%-4s %9s %12s %12s %10s %10s %10s %10s %9s\n",
+         "node", "ppm", "onboard[s]", "converge[s]", "p50[us]", "p99[us]", "max[us]", "wakeups", "backward");
+  for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+    const sim_node_stats_t *st = sim_node_stats(i);
+    const sim_node_report_t *r = &reports[i - 1];
+    double onboard = onboarded_ns(i) ? (double)(onboarded_ns(i) - st->boot_ns) / SIM_NS_PER_S : -1.0;
+    printf("%-4u %9.2f %12.3f %12.3f %10.1f %10.1f %10.1f %10u %9u\n",
+           i, cfg->peripherals[i - 1].ppm, onboard, r->convergence_s,
+           r->steady.p50, r->steady.p99, r->steady.max, st->radio_wakeups, r->backward_steps);
+  }
+}
+
+static void print_json_report(double network_onboarding_s, const sim_error_stats_t *all,
+                              const sim_error_stats_t *exchange)
+{
+  const sim_config_t *cfg = &options.config;
+  printf("{\n  \"config\": {\"nodes\": %u, \"duration_s\": %.1f, \"seed\": %u, \"gw_ppm\": %.2f, "
+         "\"latency_us\": %u, \"jitter_us\": %u, \"loss\": %.4f, \"conn_interval_ms\": %.2f},\n",
+         cfg->num_peripherals, options.duration_s, cfg->seed, cfg->gateway.ppm,
+         cfg->peripherals[0].latency_us, cfg->peripherals[0].jitter_us, cfg->loss,
+         cfg->conn_interval_us / 1000.0);
+  printf("  \"nodes\": [\n");
+  for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+    const sim_node_stats_t *st = sim_node_stats(i);
+    const sim_node_report_t *r = &reports[i - 1];
+    double onboard = onboarded_ns(i) ? (double)(onboarded_ns(i) - st->boot_ns) / SIM_NS_PER_S : -1.0;
+    printf("    {\"node\": %u, \"ppm\": %.3f, \"onboarding_s\": %.4f, \"convergence_s\": %.4f, "
+           "\"radio_wakeups\": %u, \"backward_steps\": %u, ",
+           i, cfg->peripherals[i - 1].ppm, onboard, r->convergence_s, st->radio_wakeups, r->backward_steps);
+    sim_error_stats_json(stdout, "steady_state", &r->steady);
+    printf("}%s\n", (i < cfg->num_peripherals) ? "," : "");
+  }
+  printf("  ],\n  \"summary\": {\"synced_nodes\": %u, \"network_onboarding_s\": %.4f, ",
+         sync_ready_count, network_onboarding_s);
+  sim_error_stats_json(stdout, "steady_state", all);
+  printf(", ");
+  sim_error_stats_json(stdout, "timing_exchange", exchange);
+  if (options.uplink_s > 0.0) {
+    printf(", \"uplink\": {\"sent\": %u, \"received\": %u, \"mean_age_ms\": %.3f}",
+           uplink_sent, uplink_received, uplink_received ? uplink_age_sum_ms / uplink_received : 0.0);
+  }
+  if (options.command_s > 0.0) {
+    printf(", \"downlink\": {\"queued\": %u, \"acked\": %u, \"failed\": %u, \"run\": %u, "
+           "\"mean_ack_ms\": %.3f, \"broadcasts\": %u, \"broadcasts_run\": %u}",
+           commands_queued, commands_acked, commands_failed, commands_run,
+           commands_acked ? command_latency_sum_ms / commands_acked : 0.0, broadcasts_queued, broadcasts_run);
+  }
+  printf("}\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+  const char *leave_list = NULL;
+  const char *drop_list = NULL;
+  parse_options(argc, argv, &leave_list, &drop_list);
+  sim_config_t *cfg = &options.config;
+  sim_init(cfg);
+  if (leave_list) {
+    parse_event_list(leave_list, node_leave);
+  }
+  if (drop_list) {
+    parse_event_list(drop_list, node_drop_sync);
+  }
+
+  sim_set_current_node(SIM_GATEWAY_NODE);
+  sl_status_t sc;
+  if (options.app_service) {
+    sc = ble_time_sync_init_with_config(sync_ready, &audio_stream_service, 1, &options.sync);
+  } else {
+    sc = ble_time_sync_init_with_config(sync_ready, NULL, 0, &options.sync);
+  }
+  if (sc != SL_STATUS_OK) {
+    fprintf(stderr, "invalid BLE Time Sync configuration\n");
+    return 2;
+  }
+  ble_time_sync_set_uplink_callback(uplink_data);
+  ble_time_sync_set_command_callback(command_status);
+  sim_set_handler(SIM_GATEWAY_NODE, gateway_node_on_bt_event);
+  for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+    sim_set_handler(i, peripheral_event);
+    sim_set_current_node(i);
+    sim_peripheral_entries[i - 1].set_command_callback(command_received);
+  }
+  sim_set_current_node(SIM_GATEWAY_NODE);
+  uint64_t sample_period = (uint64_t)options.sample_ms * SIM_NS_PER_MS;
+  sim_call_at(sample_period, SIM_GATEWAY_NODE, sample_offsets, sample_period);
+  if (options.uplink_s > 0.0) {
+    for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+      sim_call_at((uint64_t)(options.uplink_s * SIM_NS_PER_S), i, send_uplink, 0);
+    }
+  }
+  if (options.command_s > 0.0) {
+    uint64_t command_period = (uint64_t)(options.command_s * SIM_NS_PER_S);
+    sim_call_at(command_period, SIM_GATEWAY_NODE, send_commands, command_period);
+  }
+  sim_run((uint64_t)(options.duration_s * SIM_NS_PER_S));
+
+  sim_series_t pooled = { 0 };
+  double network_onboarding_s = 0.0;
+  for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+    evaluate_node(i);
+    if (!onboarded_ns(i)) {
+      network_onboarding_s = -1.0;
+    } else if (network_onboarding_s >= 0.0
+               && (double)onboarded_ns(i) / SIM_NS_PER_S > network_onboarding_s) {
+      network_onboarding_s = (double)onboarded_ns(i) / SIM_NS_PER_S;
+    }
+    const sim_node_report_t *r = &reports[i - 1];
+    size_t first = r->samples.count - r->steady.count;
+    for (size_t k = first; k < r->samples.count; k++) {
+      sim_series_push(&pooled, r->samples.values[k]);
+    }
+  }
+  sim_error_stats_t all;
+  sim_error_stats(pooled.values, pooled.count, &all);
+  sim_error_stats_t exchange;
+  sim_error_stats(exchange_errors.values, exchange_errors.count, &exchange);
+
+  if (options.json) {
+    print_json_report(network_onboarding_s, &all, &exchange);
+  } else {
+    print_text_report();
+    printf("network onboarding: %.3f s, synced nodes: %u, steady-state |error| p50 %.1f us, "
+           "p99 %.1f us, max %.1f us\n",
+           network_onboarding_s, sync_ready_count, all.p50, all.p99, all.max);
+    printf("timing exchange: |error| p50 %.1f us, max %.1f us after %zu exchanges\n",
+           exchange.p50, exchange.max, exchange.count);
+    if (options.uplink_s > 0.0) {
+      printf("uplink: %u of %u records received, mean age %.1f ms\n", uplink_received, uplink_sent,
+             uplink_received ? uplink_age_sum_ms / uplink_received : 0.0);
+    }
+    if (options.command_s > 0.0) {
+      printf("downlink: %u of %u commands acknowledged (%u failed, %u run), mean ack %.1f ms, "
+             "%u broadcast commands run %u times\n",
+             commands_acked, commands_queued, commands_failed, commands_run,
+             commands_acked ? command_latency_sum_ms / commands_acked : 0.0, broadcasts_queued, broadcasts_run);
+    }
+    if (options.app_service) {
+      printf("application service resolved for %u of %u synced nodes\n", app_service_resolved, sync_ready_count);
+    }
+    for (uint8_t i = 1; i <= cfg->num_peripherals; i++) {
+      const sim_node_stats_t *st = sim_node_stats(i);
+      if (st->sync_lost_ns && st->resynced_ns) {
+        printf("node %u: sync lost at %.3f s, rejoined in %.3f s\n", i, (double)st->sync_lost_ns / SIM_NS_PER_S,
+               (double)(st->resynced_ns - st->sync_lost_ns) / SIM_NS_PER_S);
+      } else if (st->sync_lost_ns) {
+        printf("node %u: sync lost at %.3f s, not rejoined\n", i, (double)st->sync_lost_ns / SIM_NS_PER_S);
+      }
+    }
+  }
+  sim_series_free(&pooled);
+  sim_series_free(&exchange_errors);
+  for (uint8_t i = 0; i < cfg->num_peripherals; i++) {
+    sim_series_free(&reports[i].samples);
+    sim_series_free(&reports[i].sample_times);
+  }
+  return 0;
+}
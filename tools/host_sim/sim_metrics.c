@@ -0,0 +1,75 @@
+/*
+ * sim_metrics.c
+ *
+ *  Offset error statistics shared by the simulator and the benchmark.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "sim_metrics.h"
+
+void sim_series_push(sim_series_t *series, double value)
+{
+  if (series->count == series->capacity) {
+    series->capacity = series->capacity ? series->capacity * 2 : 1024;
+    series->values = realloc(series->values, series->capacity * sizeof(double));
+    if (series->values == NULL) {
+      abort();
+    }
+  }
+  series->values[series->count++] = value;
+}
+
+void sim_series_free(sim_series_t *series)
+{
+  free(series->values);
+  series->values = NULL;
+  series->count = 0;
+  series->capacity = 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t count, double q)
+{
+  size_t rank = (size_t)ceil(q * (double)count);
+  return sorted[rank ? rank - 1 : 0];
+}
+
+void sim_error_stats(const double *values, size_t count, sim_error_stats_t *stats)
+{
+  stats->count = count;
+  stats->mean = stats->p50 = stats->p99 = stats->max = 0.0;
+  if (count == 0) {
+    return;
+  }
+  double *abs_values = malloc(count * sizeof(double));
+  if (abs_values == NULL) {
+    abort();
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    sum += values[i];
+    abs_values[i] = fabs(values[i]);
+  }
+  qsort(abs_values, count, sizeof(double), compare_double);
+  stats->mean = sum / (double)count;
+  stats->p50 = percentile(abs_values, count, 0.50);
+  stats->p99 = percentile(abs_values, count, 0.99);
+  stats->max = abs_values[count - 1];
+  free(abs_values);
+}
+
+void sim_error_stats_json(FILE *out, const char *name, const sim_error_stats_t *stats)
+{
+  fprintf(out, "\"%s\": {\"samples\": %zu, \"mean_us\": %.3f, \"p50_us\": %.3f, "
+               "\"p99_us\": %.3f, \"max_us\": %.3f}",
+          name, stats->count, stats->mean, stats->p50, stats->p99, stats->max);
+}
@@ -0,0 +1,34 @@
+/*
+ * sim_metrics.h
+ *
+ *  Offset error statistics shared by the simulator and the benchmark.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SIM_METRICS_H_
+#define SIM_METRICS_H_
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct sim_series_t {
+  double *values;
+  size_t  count;
+  size_t  capacity;
+} sim_series_t;
+
+typedef struct sim_error_stats_t {
+  size_t count;
+  double mean;          // signed mean
+  double p50;           // percentiles of the absolute error
+  double p99;
+  double max;
+} sim_error_stats_t;
+
+void   sim_series_push(sim_series_t *series, double value);
+void   sim_series_free(sim_series_t *series);
+void   sim_error_stats(const double *values, size_t count, sim_error_stats_t *stats);
+void   sim_error_stats_json(FILE *out, const char *name, const sim_error_stats_t *stats);
+
+#endif /* SIM_METRICS_H_ */
@@ -0,0 +1,35 @@
+/*
+ * sim_nodes.c
+ *
+ *  Table of the peripheral library copies linked into the simulator.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+#include "sim_nodes.h"
+
+#if SIM_MAX_PERIPHERALS != 16
+#error "Update SIM_PN_FOR_EACH when changing SIM_MAX_PERIPHERALS"
+#endif
+
+#define SIM_PN_FOR_EACH(X) \
+  X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  \
+  X(8)  X(9)  X(10) X(11) X(12) X(13) X(14) X(15)
+
+#define SIM_PN_DECLARE(n)                                   \
+  sl_status_t pn##n##_peripheral_node_init(const peripheral_node_config_t *config); \
+  void pn##n##_peripheral_node_on_bt_event(sl_bt_msg_t *evt); \
+  uint32_t pn##n##_get_timestamp(void);                     \
+  uint64_t pn##n##_get_timestamp64(void);                   \
+  sl_status_t pn##n##_peripheral_node_send_uplink_data(const uint8_t *data, uint8_t len); \
+  void pn##n##_peripheral_node_set_command_callback(downlink_command_cb callback);
+
+#define SIM_PN_ENTRY(n)                                     \
+  { pn##n##_peripheral_node_init, pn##n##_peripheral_node_on_bt_event, pn##n##_get_timestamp, pn##n##_get_timestamp64, \
+    pn##n##_peripheral_node_send_uplink_data, pn##n##_peripheral_node_set_command_callback },
+
+SIM_PN_FOR_EACH(SIM_PN_DECLARE)
+
+const sim_peripheral_entry_t sim_peripheral_entries[SIM_MAX_PERIPHERALS] = {
+  SIM_PN_FOR_EACH(SIM_PN_ENTRY)
+};
@@ -0,0 +1,27 @@
+/*
+ * sim_nodes.h
+ *
+ *  Entry points of the per-instance copies of the peripheral library.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SIM_NODES_H_
+#define SIM_NODES_H_
+#include "ble_time_sync.h"
+#include "sim_stack.h"
+
+typedef struct sim_peripheral_entry_t {
+  sl_status_t (*init)(const peripheral_node_config_t *config);
+  void     (*on_bt_event)(sl_bt_msg_t *evt);
+  uint32_t (*get_timestamp)(void);
+  uint64_t (*get_timestamp64)(void);
+  sl_status_t (*send_uplink_data)(const uint8_t *data, uint8_t len);
+  void     (*set_command_callback)(downlink_command_cb callback);
+} sim_peripheral_entry_t;
+
+// Indexed by peripheral number, i.e. simulator node - 1
+extern const sim_peripheral_entry_t sim_peripheral_entries[SIM_MAX_PERIPHERALS];
+
+#endif /* SIM_NODES_H_ */
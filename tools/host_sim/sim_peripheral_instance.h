@@ -0,0 +1,36 @@
+/*
+ * sim_peripheral_instance.h
+ *
+ *  Force-included when src/ble_time_sync_peripheral.c is compiled for the
+ *  host simulator. The peripheral library keeps its state in file scope, so
+ *  the Makefile builds one object per virtual peripheral and this header
+ *  gives the public symbols of each copy a pn<SIM_PN_INSTANCE>_ prefix.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SIM_PERIPHERAL_INSTANCE_H_
+#define SIM_PERIPHERAL_INSTANCE_H_
+
+#ifndef SIM_PN_INSTANCE
+#error "SIM_PN_INSTANCE must be defined for every peripheral instance"
+#endif
+
+#define SIM_PN_CAT2(a, b)               a##b
+#define SIM_PN_CAT(a, b)                SIM_PN_CAT2(a, b)
+#define SIM_PN_NAME(name)               SIM_PN_CAT(SIM_PN_CAT(pn, SIM_PN_INSTANCE), SIM_PN_CAT(_, name))
+
+#define peripheral_node_init            SIM_PN_NAME(peripheral_node_init)
+#define peripheral_node_on_bt_event     SIM_PN_NAME(peripheral_node_on_bt_event)
+#define peripheral_node_in_holdover     SIM_PN_NAME(peripheral_node_in_holdover)
+#define get_timestamp                   SIM_PN_NAME(get_timestamp)
+#define get_timestamp64                 SIM_PN_NAME(get_timestamp64)
+#define peripheral_node_ticks_to_us     SIM_PN_NAME(peripheral_node_ticks_to_us)
+#define peripheral_node_ticks_to_ns     SIM_PN_NAME(peripheral_node_ticks_to_ns)
+#define peripheral_node_us_to_ticks     SIM_PN_NAME(peripheral_node_us_to_ticks)
+#define peripheral_node_ns_to_ticks     SIM_PN_NAME(peripheral_node_ns_to_ticks)
+#define peripheral_node_send_uplink_data SIM_PN_NAME(peripheral_node_send_uplink_data)
+#define peripheral_node_set_command_callback SIM_PN_NAME(peripheral_node_set_command_callback)
+
+#endif /* SIM_PERIPHERAL_INSTANCE_H_ */
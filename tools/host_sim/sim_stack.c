@@ -0,0 +1,1674 @@
+/*
+ * sim_stack.c
+ *
+ *  Discrete-event model of the Bluetooth stack and sleeptimer used by the
+ *  host simulator. It implements the sl_bt_* / sl_sleeptimer_* subset
+ *  declared in stubs/ on top of a virtual time base:
+ *    - every node owns a sleeptimer running at 32768 Hz * (1 + ppm)
+ *    - events reach a node after its configured delivery latency
+ *    - GATT procedures advance on connection event boundaries
+ *    - the PAwR train, its subevents and response slots follow the
+ *      parameters passed to sl_bt_pawr_advertiser_start()
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "app_assert.h"
+#include "app_log.h"
+#include "gatt_db.h"
+#include "em_prs.h"
+#include "nvm3_default.h"
+#include "peripheral_sysrtc.h"
+#include "sim_stack.h"
+
+#define SIM_MAX_CONNECTIONS               SL_BT_CONFIG_MAX_CONNECTIONS
+#define SIM_PN_CONNECTION_HANDLE          1U
+#define SIM_PN_SYNC_HANDLE                1U
+#define SIM_ADV_INTERVAL_NS               (100 * SIM_NS_PER_MS)
+#define SIM_ADV_DELAY_MAX_NS              (10 * SIM_NS_PER_MS)
+#define SIM_CONN_MARGIN_NS                (300 * SIM_NS_PER_US)
+#define SIM_CONN_SUPERVISION_TIMEOUT      100U
+#define SIM_CHARS_PER_RESPONSE            3U
+#define SIM_MAX_PAWR_SUBEVENTS            128U
+#define SIM_MAX_PAWR_DATA                 251U
+#define SIM_MAX_SYNC_SUBEVENTS            8U
+#define SIM_BYTE_AIRTIME_NS               (8 * SIM_NS_PER_US)
+#define SIM_PACKET_OVERHEAD_BYTES         10U
+#define SIM_ATT_ERROR_BASE                0x1100U
+#define SIM_ATT_WRITE_NOT_PERMITTED       0x03U
+#define SIM_CLOSE_REASON_LOCAL            0x1016U
+#define SIM_CLOSE_REASON_REMOTE           0x1013U
+#define SIM_GATT_PROP_WRITE               0x08U
+#define SIM_GATT_PROP_NOTIFY              0x10U
+#define SIM_GENERIC_ACCESS_HANDLE         9U
+#define SIM_AUDIO_STREAMING_HANDLE        36U
+#define SIM_AUDIO_DATA_HANDLE             38U
+#define SIM_MAX_NVM3_OBJECTS              64U
+#define SIM_MAX_NVM3_OBJECT_SIZE          64U
+
+typedef enum {
+  SIM_EV_ARRIVAL,
+  SIM_EV_BT,
+  SIM_EV_CALL
+} sim_event_kind_t;
+
+typedef struct sim_event_t {
+  uint64_t         t;
+  uint64_t         seq;
+  sim_event_kind_t kind;
+  uint8_t          node;
+  sim_call_t       fn;
+  uint64_t         arg;
+  sl_bt_msg_t      msg;
+} sim_event_t;
+
+typedef struct sim_gatt_service_t {
+  uint16_t uuid;
+  uint32_t handle;
+} sim_gatt_service_t;
+
+typedef struct sim_gatt_characteristic_t {
+  uint32_t service;
+  uint16_t uuid;
+  uint16_t handle;
+  uint8_t  properties;
+} sim_gatt_characteristic_t;
+
+typedef struct sim_node_t {
+  sim_node_config_t   config;
+  sim_event_handler_t handler;
+  sim_node_stats_t    stats;
+  bd_addr             address;
+  uint64_t            tick_base;
+  bool                tick_overridden;
+  uint64_t            tick_override;
+  uint64_t            last_delivery_ns;
+  bool                powered_off;
+  // legacy advertiser
+  bool                advertising;
+  bool                adv_ticking;
+  uint8_t             adv_data[31];
+  uint8_t             adv_data_len;
+  // scanner, listening for scan_window_ns of every scan_interval_ns
+  bool                scanning;
+  uint64_t            scan_interval_ns;
+  uint64_t            scan_window_ns;
+  // PAST receiver and PAwR synchronization
+  uint8_t             past_mode;
+  uint16_t            past_skip;
+  uint16_t            past_timeout;
+  bool                synced;
+  uint16_t            sync_skip;
+  uint16_t            sync_timeout;
+  uint8_t             sync_subevents[SIM_MAX_SYNC_SUBEVENTS];
+  uint8_t             num_sync_subevents;
+  uint64_t            sync_last_rx_ns;
+  uint64_t            sync_last_rx_event;   // skip counts from the last received event
+  uint64_t            sync_next_event;      // first event the receiver listens to again
+  // radio signal routed to the capture channel of the SYSRTC
+  uint16_t            prs_signal;
+  bool                prs_to_sysrtc;
+  SYSRTC_TypeDef      sysrtc;
+  // sync scanner, the train is opened again without a sync transfer
+  bool                sync_pending;
+  uint16_t            sync_scan_skip;
+  uint16_t            sync_scan_timeout;
+  uint64_t            adv_interval_ns;
+  // response queued for the next response slot
+  uint8_t             response_subevent;
+  uint8_t             response_slot;
+  uint8_t             response_len;
+  uint8_t             response_data[SIM_MAX_PAWR_DATA];
+} sim_node_t;
+
+typedef struct sim_connection_t {
+  bool     allocated;
+  bool     open;
+  bool     closing;
+  bool     gatt_busy;
+  uint8_t  peripheral;
+  uint64_t anchor_ns;
+  uint64_t interval_ns;
+} sim_connection_t;
+
+typedef struct sim_pawr_subevent_t {
+  bool    valid;
+  uint8_t response_slot_start;
+  uint8_t response_slot_count;
+  uint8_t len;
+  uint8_t data[SIM_MAX_PAWR_DATA];
+} sim_pawr_subevent_t;
+
+typedef struct sim_pawr_t {
+  bool                started;
+  uint8_t             advertising_set;
+  uint16_t            interval_units;
+  uint8_t             num_subevents;
+  uint8_t             subevent_interval_units;
+  uint8_t             response_slot_delay_units;
+  uint8_t             response_slot_spacing_units;
+  uint8_t             response_slots;
+  uint64_t            interval_ns;
+  uint64_t            subevent_interval_ns;
+  uint64_t            response_slot_delay_ns;
+  uint64_t            response_slot_spacing_ns;
+  uint64_t            t0_ns;
+  uint64_t            event;
+  bool                sync_info;            // extended advertising with the SyncInfo
+  uint64_t            sync_info_interval_ns;
+  uint16_t            generation;
+  sim_pawr_subevent_t subevents[SIM_MAX_PAWR_SUBEVENTS];
+} sim_pawr_t;
+
+static const sim_gatt_service_t sim_gatt_services[] = {
+  { 0x1801U, gattdb_generic_attribute },
+  { 0x1800U, SIM_GENERIC_ACCESS_HANDLE },
+  { 0x180AU, gattdb_device_information },
+  { 0x98C7U, gattdb_pawr_configuration },
+  { 0x95CBU, SIM_AUDIO_STREAMING_HANDLE },
+};
+
+static const sim_gatt_characteristic_t sim_gatt_characteristics[] = {
+  { gattdb_pawr_configuration,  0x690BU, gattdb_peripheral_node_id, SIM_GATT_PROP_WRITE },
+  { gattdb_pawr_configuration,  0xB8A5U, gattdb_subevent_id,        SIM_GATT_PROP_WRITE },
+  { gattdb_pawr_configuration,  0x509AU, gattdb_wall_clock_time,    SIM_GATT_PROP_WRITE },
+  { gattdb_pawr_configuration,  0x9AC6U, gattdb_clock_correction,   SIM_GATT_PROP_WRITE },
+  { gattdb_pawr_configuration,  0x3C5EU, gattdb_provisioning,       SIM_GATT_PROP_WRITE },
+  { SIM_AUDIO_STREAMING_HANDLE, 0x976BU, SIM_AUDIO_DATA_HANDLE,     SIM_GATT_PROP_NOTIFY },
+};
+
+// Advertised 16-bit service UUIDs of a peripheral node
+static const uint16_t sim_advertised_services[] = { 0x98C7U };
+
+static sim_config_t     config;
+typedef struct sim_nvm3_object_t {
+  bool             used;
+  uint8_t          node;
+  nvm3_ObjectKey_t key;
+  size_t           len;
+  uint8_t          data[SIM_MAX_NVM3_OBJECT_SIZE];
+} sim_nvm3_object_t;
+
+static sim_node_t       nodes[SIM_MAX_NODES];
+static sim_nvm3_object_t nvm3_objects[SIM_MAX_NVM3_OBJECTS];
+static nvm3_Handle_t    nvm3_default_instance;
+nvm3_Handle_t           *nvm3_defaultHandle = &nvm3_default_instance;
+static sim_connection_t connections[SIM_MAX_CONNECTIONS + 1];
+// Counts the connections a handle carried, the procedures of a closed one
+// do not complete on the next one
+static uint32_t         connection_generations[SIM_MAX_CONNECTIONS + 1];
+static sim_pawr_t       pawr;
+static uint8_t          pending_connection = SL_BT_INVALID_CONNECTION_HANDLE;
+static uint8_t          current_node = SIM_GATEWAY_NODE;
+static uint64_t         now_ns = 0;
+static uint64_t         event_seq = 0;
+static uint64_t         rng_state = 1;
+static sim_event_t     *queue = NULL;
+static size_t           queue_len = 0;
+static size_t           queue_cap = 0;
+
+
+// -----------------------------------------------------------------------------
+// Event queue (binary min-heap ordered by time, then insertion order)
+
+static bool event_before(const sim_event_t *a, const sim_event_t *b)
+{
+  return (a->t < b->t) || (a->t == b->t && a->seq < b->seq);
+}
+
+static void queue_push(const sim_event_t *evt)
+{
+  if (queue_len == queue_cap) {
+    queue_cap = queue_cap ? queue_cap * 2 : 256;
+    queue = realloc(queue, queue_cap * sizeof(*queue));
+    app_assert(queue != NULL);
+  }
+  size_t i = queue_len++;
+  queue[i] = *evt;
+  queue[i].seq = event_seq++;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!event_before(&queue[i], &queue[parent])) {
+      break;
+    }
+    sim_event_t tmp = queue[i];
+    queue[i] = queue[parent];
+    queue[parent] = tmp;
+    i = parent;
+  }
+}
+
+static void queue_pop(sim_event_t *out)
+{
+  *out = queue[0];
+  queue[0] = queue[--queue_len];
+  size_t i = 0;
+  for (;;) {
+    size_t l = 2 * i + 1;
+    size_t r = l + 1;
+    size_t m = i;
+    if (l < queue_len && event_before(&queue[l], &queue[m])) {
+      m = l;
+    }
+    if (r < queue_len && event_before(&queue[r], &queue[m])) {
+      m = r;
+    }
+    if (m == i) {
+      break;
+    }
+    sim_event_t tmp = queue[i];
+    queue[i] = queue[m];
+    queue[m] = tmp;
+    i = m;
+  }
+}
+
+
+// -----------------------------------------------------------------------------
+// Simulator core
+
+uint32_t sim_random(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+double sim_random_unit(void)
+{
+  return (double)sim_random() / 4294967296.0;
+}
+
+void sim_call_at(uint64_t t_ns, uint8_t node, sim_call_t fn, uint64_t arg)
+{
+  sim_event_t evt = { .t = t_ns, .kind = SIM_EV_CALL, .node = node, .fn = fn, .arg = arg };
+  queue_push(&evt);
+}
+
+void sim_deliver(uint8_t node, uint64_t t_ns, const sl_bt_msg_t *msg)
+{
+  if (nodes[node].powered_off) {
+    return;
+  }
+  // events produced ahead of time enter the application queue on arrival
+  if (t_ns > now_ns) {
+    sim_event_t arrival = { .t = t_ns, .kind = SIM_EV_ARRIVAL, .node = node, .msg = *msg };
+    queue_push(&arrival);
+    return;
+  }
+  const sim_node_config_t *cfg = &nodes[node].config;
+  uint64_t latency_ns = (uint64_t)cfg->latency_us * SIM_NS_PER_US;
+  if (cfg->jitter_us) {
+    latency_ns += (uint64_t)(sim_random_unit() * cfg->jitter_us * SIM_NS_PER_US);
+  }
+  uint64_t t = t_ns + latency_ns;
+  // the application processes its event queue in order
+  if (t < nodes[node].last_delivery_ns) {
+    t = nodes[node].last_delivery_ns;
+  }
+  nodes[node].last_delivery_ns = t;
+  sim_event_t evt = { .t = t, .kind = SIM_EV_BT, .node = node, .msg = *msg };
+  queue_push(&evt);
+}
+
+static void boot_node(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_system_boot_id };
+  msg.data.evt_system_boot.major = 7;
+  msg.data.evt_system_boot.minor = 1;
+  msg.data.evt_system_boot.patch = 1;
+  nodes[node].stats.boot_ns = now_ns;
+  sim_deliver(node, now_ns, &msg);
+}
+
+void sim_init(const sim_config_t *cfg)
+{
+  config = *cfg;
+  rng_state = ((uint64_t)config.seed << 1) | 1U;
+  memset(nodes, 0, sizeof(nodes));
+  memset(nvm3_objects, 0, sizeof(nvm3_objects));
+  memset(connections, 0, sizeof(connections));
+  memset(connection_generations, 0, sizeof(connection_generations));
+  memset(&pawr, 0, sizeof(pawr));
+  pending_connection = SL_BT_INVALID_CONNECTION_HANDLE;
+  queue_len = 0;
+  now_ns = 0;
+
+  for (uint8_t i = 0; i <= config.num_peripherals; i++) {
+    sim_node_t *n = &nodes[i];
+    n->config = (i == SIM_GATEWAY_NODE) ? config.gateway : config.peripherals[i - 1];
+    n->tick_base = config.tick_base + (sim_random() & 0x00FFFFFFU);
+    n->address.addr[0] = i;
+    n->address.addr[1] = (uint8_t)(0x40U + i);
+    n->address.addr[2] = 0x57U;
+    n->address.addr[3] = 0x6BU;
+    n->address.addr[4] = 0x2EU;
+    n->address.addr[5] = (i == SIM_GATEWAY_NODE) ? 0xC0U : 0xCCU;
+    sim_call_at((uint64_t)n->config.boot_ms * SIM_NS_PER_MS, i, boot_node, 0);
+  }
+}
+
+void sim_set_handler(uint8_t node, sim_event_handler_t handler)
+{
+  nodes[node].handler = handler;
+}
+
+void sim_run(uint64_t until_ns)
+{
+  sim_event_t evt;
+  while (queue_len > 0 && queue[0].t <= until_ns) {
+    queue_pop(&evt);
+    now_ns = evt.t;
+    uint8_t prev = current_node;
+    current_node = evt.node;
+    if (evt.kind == SIM_EV_ARRIVAL) {
+      sim_deliver(evt.node, now_ns, &evt.msg);
+    } else if (evt.kind == SIM_EV_BT) {
+      if (nodes[evt.node].handler) {
+        nodes[evt.node].handler(&evt.msg);
+      }
+    } else {
+      evt.fn(evt.node, evt.arg);
+    }
+    current_node = prev;
+  }
+  now_ns = until_ns;
+}
+
+uint64_t sim_now_ns(void)
+{
+  return now_ns;
+}
+
+uint8_t sim_current_node(void)
+{
+  return current_node;
+}
+
+void sim_set_current_node(uint8_t node)
+{
+  current_node = node;
+}
+
+uint64_t sim_node_tick64(uint8_t node)
+{
+  const sim_node_t *n = &nodes[node];
+  if (n->tick_overridden) {
+    return n->tick_override;
+  }
+  long double ticks = (long double)now_ns * SIM_TIMER_FREQUENCY
+                      * (1.0L + (long double)n->config.ppm * 1e-6L) / 1e9L;
+  return n->tick_base + (uint64_t)ticks;
+}
+
+void sim_node_override_tick(uint8_t node, bool enable, uint64_t tick)
+{
+  nodes[node].tick_overridden = enable;
+  nodes[node].tick_override = tick;
+}
+
+bool sim_node_is_synced(uint8_t node)
+{
+  return nodes[node].synced;
+}
+
+// Puts a peripheral into the synchronized state without a gateway, so that
+// recorded or synthetic subevent reports can be fed to it directly.
+void sim_node_force_sync(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+  n->synced = true;
+  n->sync_skip = 0;
+  n->sync_timeout = UINT16_MAX;
+  n->num_sync_subevents = 0;
+  n->sync_last_rx_ns = now_ns;
+  n->stats.synced_ns = now_ns;
+}
+
+const sim_node_stats_t *sim_node_stats(uint8_t node)
+{
+  return &nodes[node].stats;
+}
+
+uint8_t sim_connection_peripheral(uint8_t connection)
+{
+  if (connection == 0 || connection > SIM_MAX_CONNECTIONS || !connections[connection].allocated) {
+    return SIM_GATEWAY_NODE;
+  }
+  return connections[connection].peripheral;
+}
+
+void sim_log(int level, const char *fmt, ...)
+{
+  if (level > config.log_level) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  if (current_node == SIM_GATEWAY_NODE) {
+    fprintf(stderr, "[%12.3f ms] GW : ", (double)now_ns / SIM_NS_PER_MS);
+  } else {
+    fprintf(stderr, "[%12.3f ms] P%02u: ", (double)now_ns / SIM_NS_PER_MS, current_node);
+  }
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+void sim_assert_failed(const char *file, int line, const char *expr)
+{
+  fprintf(stderr, "[%12.3f ms] node %u: assertion failed at %s:%d: %s\n",
+          (double)now_ns / SIM_NS_PER_MS, current_node, file, line, expr);
+  abort();
+}
+
+
+// -----------------------------------------------------------------------------
+// System
+
+sl_status_t sl_bt_external_signal(uint32_t signals)
+{
+  sl_bt_msg_t msg = { .header = sl_bt_evt_system_external_signal_id };
+  msg.data.evt_system_external_signal.extsignals = signals;
+  sim_deliver(current_node, now_ns, &msg);
+  return SL_STATUS_OK;
+}
+
+
+// -----------------------------------------------------------------------------
+// PRS and SYSRTC capture
+
+int PRS_GetFreeChannel(PRS_ChType_t type)
+{
+  (void)type;
+  return 0;
+}
+
+void PRS_ConnectSignal(unsigned int ch, PRS_ChType_t type, PRS_Signal_t signal)
+{
+  (void)ch;
+  (void)type;
+  nodes[current_node].prs_signal = (uint16_t)signal;
+}
+
+void PRS_ConnectConsumer(unsigned int ch, PRS_ChType_t type, PRS_Consumer_t consumer)
+{
+  (void)ch;
+  (void)type;
+  nodes[current_node].prs_to_sysrtc = (consumer == prsConsumerSYSRTC0_SRC0);
+}
+
+SYSRTC_TypeDef *sim_sysrtc(void)
+{
+  return &nodes[current_node].sysrtc;
+}
+
+void sl_sysrtc_unlock(void)
+{
+}
+
+void sl_sysrtc_lock(void)
+{
+}
+
+uint32_t sl_sysrtc_get_group_interrupts(uint8_t group_number)
+{
+  (void)group_number;
+  return nodes[current_node].sysrtc.GRP0_IF;
+}
+
+void sl_sysrtc_clear_group_interrupts(uint8_t group_number, uint32_t flags)
+{
+  (void)group_number;
+  nodes[current_node].sysrtc.GRP0_IF &= ~flags;
+}
+
+uint32_t sl_sysrtc_get_group_capture_channel_value(uint8_t group_number)
+{
+  (void)group_number;
+  return nodes[current_node].sysrtc.GRP0_CAP0VALUE;
+}
+
+void sim_node_capture(uint8_t node, uint64_t tick)
+{
+  sim_node_t *n = &nodes[node];
+  if (!n->prs_to_sysrtc || !(n->sysrtc.GRP0_CTRL & SYSRTC_GRP0_CTRL_CAP0EN)) {
+    return;
+  }
+  n->sysrtc.GRP0_CAP0VALUE = (uint32_t)tick;
+  n->sysrtc.GRP0_IF |= SYSRTC_GRP0_IF_CAP0;
+}
+
+// The radio signal latches the sleeptimer of the node at the current time
+static void radio_capture(uint8_t node, uint16_t signal)
+{
+  if (nodes[node].prs_signal != signal) {
+    return;
+  }
+  sim_node_capture(node, sim_node_tick64(node));
+}
+
+
+// -----------------------------------------------------------------------------
+// Sleeptimer
+
+uint32_t sl_sleeptimer_get_tick_count(void)
+{
+  return (uint32_t)sim_node_tick64(current_node);
+}
+
+uint64_t sl_sleeptimer_get_tick_count64(void)
+{
+  return sim_node_tick64(current_node);
+}
+
+uint32_t sl_sleeptimer_get_timer_frequency(void)
+{
+  return SIM_TIMER_FREQUENCY;
+}
+
+sl_status_t sl_sleeptimer_ms32_to_tick(uint32_t time_ms, uint32_t *tick)
+{
+  *tick = (uint32_t)(((uint64_t)time_ms * SIM_TIMER_FREQUENCY) / 1000U);
+  return SL_STATUS_OK;
+}
+
+static void sleeptimer_expired(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  sl_sleeptimer_timer_handle_t *handle = (sl_sleeptimer_timer_handle_t *)(uintptr_t)arg;
+  // a timer stopped or restarted since has another expiry
+  if (!handle->running || handle->expiry_ns != now_ns || nodes[current_node].powered_off) {
+    return;
+  }
+  handle->running = false;
+  handle->callback(handle, handle->callback_data);
+}
+
+sl_status_t sl_sleeptimer_start_timer(sl_sleeptimer_timer_handle_t *handle,
+                                      uint32_t timeout,
+                                      sl_sleeptimer_timer_callback_t callback,
+                                      void *callback_data,
+                                      uint8_t priority,
+                                      uint16_t option_flags)
+{
+  (void)priority;
+  (void)option_flags;
+  if (handle->running) {
+    return SL_STATUS_NOT_READY;
+  }
+  long double ns = (long double)timeout * 1e9L
+                   / (SIM_TIMER_FREQUENCY * (1.0L + (long double)nodes[current_node].config.ppm * 1e-6L));
+  handle->callback = callback;
+  handle->callback_data = callback_data;
+  handle->running = true;
+  handle->expiry_ns = now_ns + (uint64_t)ns;
+  sim_call_at(handle->expiry_ns, current_node, sleeptimer_expired, (uint64_t)(uintptr_t)handle);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_sleeptimer_restart_timer(sl_sleeptimer_timer_handle_t *handle,
+                                        uint32_t timeout,
+                                        sl_sleeptimer_timer_callback_t callback,
+                                        void *callback_data,
+                                        uint8_t priority,
+                                        uint16_t option_flags)
+{
+  handle->running = false;
+  return sl_sleeptimer_start_timer(handle, timeout, callback, callback_data, priority, option_flags);
+}
+
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle)
+{
+  if (!handle->running) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  handle->running = false;
+  return SL_STATUS_OK;
+}
+
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick)
+{
+  return (uint32_t)(((uint64_t)tick * 1000U) / SIM_TIMER_FREQUENCY);
+}
+
+
+// -----------------------------------------------------------------------------
+// Connections
+
+static sim_connection_t *connection_of(uint8_t node, uint8_t handle)
+{
+  if (node == SIM_GATEWAY_NODE) {
+    if (handle == 0 || handle > SIM_MAX_CONNECTIONS) {
+      return NULL;
+    }
+    sim_connection_t *c = &connections[handle];
+    return (c->allocated && c->open && !c->closing) ? c : NULL;
+  }
+  if (handle != SIM_PN_CONNECTION_HANDLE) {
+    return NULL;
+  }
+  for (uint8_t h = 1; h <= SIM_MAX_CONNECTIONS; h++) {
+    sim_connection_t *c = &connections[h];
+    if (c->allocated && c->open && !c->closing && c->peripheral == node) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+static uint8_t gateway_handle_of(const sim_connection_t *c)
+{
+  return (uint8_t)(c - connections);
+}
+
+// First connection event at least SIM_CONN_MARGIN_NS after t
+static uint64_t next_connection_event(const sim_connection_t *c, uint64_t t)
+{
+  uint64_t earliest = t + SIM_CONN_MARGIN_NS;
+  if (earliest <= c->anchor_ns) {
+    return c->anchor_ns;
+  }
+  uint64_t n = (earliest - c->anchor_ns + c->interval_ns - 1) / c->interval_ns;
+  return c->anchor_ns + n * c->interval_ns;
+}
+
+// Every connection event carries a packet each way, an empty one without
+// data, so the radio signals of both sides fire with it as well
+static void connection_event(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  uint8_t handle = (uint8_t)(arg & 0xFFU);
+  sim_connection_t *c = &connections[handle];
+  if (!c->allocated || !c->open || (uint32_t)(arg >> 32) != connection_generations[handle]) {
+    return;
+  }
+  radio_capture(SIM_GATEWAY_NODE, PRS_MODEM_SYNCSENT);
+  radio_capture(c->peripheral, PRS_MODEM_FRAMEDET);
+  sim_call_at(now_ns + c->interval_ns, SIM_GATEWAY_NODE, connection_event, arg);
+}
+
+static void connection_established(uint8_t handle)
+{
+  sim_connection_t *c = &connections[handle];
+  sim_node_t *pn = &nodes[c->peripheral];
+  c->open = true;
+  c->interval_ns = (uint64_t)config.conn_interval_us * SIM_NS_PER_US;
+  c->anchor_ns = now_ns + 1250 * SIM_NS_PER_US
+                 + (uint64_t)(sim_random_unit() * (double)c->interval_ns);
+  pending_connection = SL_BT_INVALID_CONNECTION_HANDLE;
+  pn->advertising = false;
+  if (!pn->stats.connected_ns) {
+    pn->stats.connected_ns = c->anchor_ns;
+  }
+
+  sl_bt_msg_t msg = { .header = sl_bt_evt_connection_opened_id };
+  msg.data.evt_connection_opened.address = pn->address;
+  msg.data.evt_connection_opened.master = 1;
+  msg.data.evt_connection_opened.connection = handle;
+  msg.data.evt_connection_opened.bonding = 0xFF;
+  msg.data.evt_connection_opened.advertiser = 0xFF;
+  msg.data.evt_connection_opened.sync = SL_BT_INVALID_SYNC_HANDLE;
+  sim_deliver(SIM_GATEWAY_NODE, c->anchor_ns, &msg);
+  msg.data.evt_connection_opened.address = nodes[SIM_GATEWAY_NODE].address;
+  msg.data.evt_connection_opened.master = 0;
+  msg.data.evt_connection_opened.connection = SIM_PN_CONNECTION_HANDLE;
+  msg.data.evt_connection_opened.advertiser = 0;
+  sim_deliver(c->peripheral, c->anchor_ns, &msg);
+
+  msg.header = sl_bt_evt_connection_parameters_id;
+  memset(&msg.data, 0, sizeof(msg.data));
+  msg.data.evt_connection_parameters.interval = (uint16_t)(config.conn_interval_us / 1250U);
+  msg.data.evt_connection_parameters.timeout = SIM_CONN_SUPERVISION_TIMEOUT;
+  msg.data.evt_connection_parameters.txsize = 27;
+  msg.data.evt_connection_parameters.connection = handle;
+  sim_deliver(SIM_GATEWAY_NODE, c->anchor_ns, &msg);
+  msg.data.evt_connection_parameters.connection = SIM_PN_CONNECTION_HANDLE;
+  sim_deliver(c->peripheral, c->anchor_ns, &msg);
+  sim_call_at(c->anchor_ns, SIM_GATEWAY_NODE, connection_event,
+              handle | ((uint64_t)connection_generations[handle] << 32));
+}
+
+static void connection_terminated(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  uint8_t handle = (uint8_t)(arg & 0xFFU);
+  bool closed_by_gateway = (arg >> 8) != 0;
+  sim_connection_t *c = &connections[handle];
+  sl_bt_msg_t msg = { .header = sl_bt_evt_connection_closed_id };
+  msg.data.evt_connection_closed.reason = closed_by_gateway ? SIM_CLOSE_REASON_LOCAL : SIM_CLOSE_REASON_REMOTE;
+  msg.data.evt_connection_closed.connection = handle;
+  sim_deliver(SIM_GATEWAY_NODE, now_ns, &msg);
+  msg.data.evt_connection_closed.reason = closed_by_gateway ? SIM_CLOSE_REASON_REMOTE : SIM_CLOSE_REASON_LOCAL;
+  msg.data.evt_connection_closed.connection = SIM_PN_CONNECTION_HANDLE;
+  sim_deliver(c->peripheral, now_ns, &msg);
+  memset(c, 0, sizeof(*c));
+  connection_generations[handle]++;
+}
+
+// Powers a peripheral off: it stops advertising and listening, and the
+// gateway sees its connection time out.
+void sim_node_leave(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+  n->powered_off = true;
+  n->advertising = false;
+  n->synced = false;
+  n->sync_pending = false;
+  n->num_sync_subevents = 0;
+  for (uint8_t h = 1; h <= SIM_MAX_CONNECTIONS; h++) {
+    sim_connection_t *c = &connections[h];
+    if (c->allocated && c->open && !c->closing && c->peripheral == node) {
+      c->closing = true;
+      sim_call_at(now_ns + SIM_CONN_SUPERVISION_TIMEOUT * 10U * SIM_NS_PER_MS,
+                  SIM_GATEWAY_NODE, connection_terminated, h);
+    }
+  }
+}
+
+// The peripheral loses the PAwR train, e.g. after a radio outage, and the
+// stack reports the sync as closed
+void sim_node_drop_sync(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+  if (n->powered_off || !n->synced) {
+    return;
+  }
+  n->synced = false;
+  n->num_sync_subevents = 0;
+  n->stats.sync_lost_ns = now_ns;
+  n->stats.resynced_ns = 0;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_sync_closed_id };
+  msg.data.evt_sync_closed.reason = SL_STATUS_TIMEOUT;
+  msg.data.evt_sync_closed.sync = SIM_PN_SYNC_HANDLE;
+  sim_deliver(node, now_ns, &msg);
+}
+
+sl_status_t sl_bt_connection_open(bd_addr address,
+                                  uint8_t address_type,
+                                  uint8_t initiating_phy,
+                                  uint8_t *connection)
+{
+  (void)address_type;
+  (void)initiating_phy;
+  if (pending_connection != SL_BT_INVALID_CONNECTION_HANDLE) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  uint8_t target = 0;
+  for (uint8_t i = 1; i <= config.num_peripherals; i++) {
+    if (memcmp(nodes[i].address.addr, address.addr, sizeof(address.addr)) == 0) {
+      target = i;
+    }
+  }
+  if (target == 0) {
+    return SL_STATUS_NOT_FOUND;
+  }
+  for (uint8_t h = 1; h <= SIM_MAX_CONNECTIONS; h++) {
+    if (!connections[h].allocated) {
+      memset(&connections[h], 0, sizeof(connections[h]));
+      connections[h].allocated = true;
+      connections[h].peripheral = target;
+      pending_connection = h;
+      *connection = h;
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_NO_MORE_RESOURCE;
+}
+
+sl_status_t sl_bt_connection_close(uint8_t connection)
+{
+  sim_connection_t *c = connection_of(current_node, connection);
+  if (c == NULL) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  c->closing = true;
+  uint64_t arg = gateway_handle_of(c) | ((current_node == SIM_GATEWAY_NODE) ? 0x100U : 0U);
+  sim_call_at(next_connection_event(c, now_ns), current_node, connection_terminated, arg);
+  return SL_STATUS_OK;
+}
+
+
+// -----------------------------------------------------------------------------
+// Legacy advertiser and scanner
+
+static void advertising_event(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  sim_node_t *n = &nodes[node];
+  if (!n->advertising) {
+    n->adv_ticking = false;
+    return;
+  }
+  if (pending_connection != SL_BT_INVALID_CONNECTION_HANDLE
+      && connections[pending_connection].peripheral == node) {
+    connection_established(pending_connection);
+    n->adv_ticking = false;
+    return;
+  }
+  const sim_node_t *gw = &nodes[SIM_GATEWAY_NODE];
+  if (gw->scanning && (gw->scan_interval_ns == 0 || now_ns % gw->scan_interval_ns < gw->scan_window_ns)) {
+    sl_bt_msg_t msg = { .header = sl_bt_evt_scanner_legacy_advertisement_report_id };
+    sl_bt_evt_scanner_legacy_advertisement_report_t *rep = &msg.data.evt_scanner_legacy_advertisement_report;
+    rep->event_flags = SL_BT_SCANNER_EVENT_FLAG_CONNECTABLE | SL_BT_SCANNER_EVENT_FLAG_SCANNABLE;
+    rep->address = n->address;
+    rep->address_type = sl_bt_gap_public_address;
+    rep->bonding = 0xFF;
+    rep->rssi = -60;
+    rep->channel = 37;
+    rep->data.len = n->adv_data_len;
+    memcpy(rep->data.data, n->adv_data, n->adv_data_len);
+    sim_deliver(SIM_GATEWAY_NODE, now_ns, &msg);
+  }
+  uint64_t next = now_ns + SIM_ADV_INTERVAL_NS + (uint64_t)(sim_random_unit() * SIM_ADV_DELAY_MAX_NS);
+  sim_call_at(next, node, advertising_event, 0);
+}
+
+sl_status_t sl_bt_advertiser_create_set(uint8_t *advertising_set)
+{
+  *advertising_set = 0;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_set_timing(uint8_t advertising_set,
+                                        uint32_t interval_min,
+                                        uint32_t interval_max,
+                                        uint16_t duration,
+                                        uint8_t maxevents)
+{
+  (void)advertising_set;
+  (void)interval_max;
+  (void)duration;
+  (void)maxevents;
+  // in 0.625 ms units
+  nodes[current_node].adv_interval_ns = (uint64_t)interval_min * 625U * SIM_NS_PER_US;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_extended_advertiser_set_data(uint8_t advertising_set,
+                                               size_t data_len,
+                                               const uint8_t* data)
+{
+  (void)advertising_set;
+  (void)data;
+  return (data_len > SIM_MAX_PAWR_DATA) ? SL_STATUS_INVALID_PARAMETER : SL_STATUS_OK;
+}
+
+// Only the SyncInfo of the PAwR train is modelled, the advertising itself
+// does not take airtime from the train
+sl_status_t sl_bt_extended_advertiser_start(uint8_t advertising_set,
+                                            uint8_t connect,
+                                            uint32_t flags)
+{
+  (void)flags;
+  if (current_node != SIM_GATEWAY_NODE || connect != sl_bt_extended_advertiser_non_connectable) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+  pawr.sync_info = true;
+  pawr.sync_info_interval_ns = nodes[current_node].adv_interval_ns ? nodes[current_node].adv_interval_ns
+                                                                   : SIM_ADV_INTERVAL_NS;
+  (void)advertising_set;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t advertising_set,
+                                                  uint8_t discover)
+{
+  (void)advertising_set;
+  (void)discover;
+  sim_node_t *n = &nodes[current_node];
+  uint8_t *p = n->adv_data;
+  // Flags: LE General Discoverable, BR/EDR not supported
+  *p++ = 0x02;
+  *p++ = 0x01;
+  *p++ = 0x06;
+  // Complete list of advertised 16-bit service UUIDs
+  *p++ = (uint8_t)(1U + 2U * (sizeof(sim_advertised_services) / sizeof(sim_advertised_services[0])));
+  *p++ = 0x03;
+  for (size_t i = 0; i < sizeof(sim_advertised_services) / sizeof(sim_advertised_services[0]); i++) {
+    *p++ = (uint8_t)(sim_advertised_services[i] & 0xFFU);
+    *p++ = (uint8_t)(sim_advertised_services[i] >> 8);
+  }
+  n->adv_data_len = (uint8_t)(p - n->adv_data);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t advertising_set, uint8_t connect)
+{
+  (void)advertising_set;
+  (void)connect;
+  sim_node_t *n = &nodes[current_node];
+  n->advertising = true;
+  if (!n->adv_ticking) {
+    n->adv_ticking = true;
+    sim_call_at(now_ns + (uint64_t)(sim_random_unit() * SIM_ADV_DELAY_MAX_NS),
+                current_node, advertising_event, 0);
+  }
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_scanner_start(uint8_t scanning_phy, uint8_t discover_mode)
+{
+  (void)scanning_phy;
+  (void)discover_mode;
+  nodes[current_node].scanning = true;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_scanner_stop(void)
+{
+  nodes[current_node].scanning = false;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_scanner_set_parameters(uint8_t mode, uint16_t interval, uint16_t window)
+{
+  (void)mode;
+  if (interval < 4 || window < 4 || window > interval) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  // both in 0.625 ms units
+  nodes[current_node].scan_interval_ns = (uint64_t)interval * 625U * SIM_NS_PER_US;
+  nodes[current_node].scan_window_ns = (uint64_t)window * 625U * SIM_NS_PER_US;
+  return SL_STATUS_OK;
+}
+
+
+// -----------------------------------------------------------------------------
+// GATT client (gateway) and GATT server (peripheral)
+
+static void gatt_procedure_completed(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  uint8_t handle = (uint8_t)(arg & 0xFFU);
+  sim_connection_t *c = &connections[handle];
+  if (!c->allocated || !c->open || (uint32_t)(arg >> 32) != connection_generations[handle]) {
+    return;
+  }
+  c->gatt_busy = false;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_gatt_procedure_completed_id };
+  msg.data.evt_gatt_procedure_completed.connection = handle;
+  msg.data.evt_gatt_procedure_completed.result = (uint16_t)(arg >> 8);
+  sim_deliver(SIM_GATEWAY_NODE, now_ns, &msg);
+}
+
+static void gatt_complete_at(uint64_t t_ns, uint8_t handle, uint16_t result)
+{
+  uint64_t arg = handle | ((uint64_t)result << 8) | ((uint64_t)connection_generations[handle] << 32);
+  sim_call_at(t_ns, SIM_GATEWAY_NODE, gatt_procedure_completed, arg);
+}
+
+static sim_connection_t *gatt_begin(uint8_t connection, sl_status_t *sc)
+{
+  sim_connection_t *c = connection_of(current_node, connection);
+  if (current_node != SIM_GATEWAY_NODE || c == NULL) {
+    *sc = SL_STATUS_INVALID_HANDLE;
+    return NULL;
+  }
+  if (c->gatt_busy) {
+    *sc = SL_STATUS_INVALID_STATE;
+    return NULL;
+  }
+  c->gatt_busy = true;
+  *sc = SL_STATUS_OK;
+  return c;
+}
+
+static void gatt_deliver_service(uint8_t connection, uint64_t t, const sim_gatt_service_t *s)
+{
+  sl_bt_msg_t msg = { .header = sl_bt_evt_gatt_service_id };
+  msg.data.evt_gatt_service.connection = connection;
+  msg.data.evt_gatt_service.service = s->handle;
+  msg.data.evt_gatt_service.uuid.len = 2;
+  msg.data.evt_gatt_service.uuid.data[0] = (uint8_t)(s->uuid & 0xFFU);
+  msg.data.evt_gatt_service.uuid.data[1] = (uint8_t)(s->uuid >> 8);
+  sim_deliver(SIM_GATEWAY_NODE, t, &msg);
+}
+
+sl_status_t sl_bt_gatt_discover_primary_services(uint8_t connection)
+{
+  sl_status_t sc;
+  sim_connection_t *c = gatt_begin(connection, &sc);
+  if (c == NULL) {
+    return sc;
+  }
+  uint64_t t = next_connection_event(c, now_ns);
+  for (size_t i = 0; i < sizeof(sim_gatt_services) / sizeof(sim_gatt_services[0]); i++) {
+    gatt_deliver_service(connection, t, &sim_gatt_services[i]);
+  }
+  gatt_complete_at(t + 2 * c->interval_ns, connection, 0U);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_discover_primary_services_by_uuid(uint8_t connection,
+                                                         size_t uuid_len,
+                                                         const uint8_t* uuid)
+{
+  sl_status_t sc;
+  sim_connection_t *c = gatt_begin(connection, &sc);
+  if (c == NULL) {
+    return sc;
+  }
+  uint64_t t = next_connection_event(c, now_ns);
+  if (uuid_len == 2) {
+    uint16_t uuid16 = (uint16_t)(uuid[0] | (uuid[1] << 8));
+    for (size_t i = 0; i < sizeof(sim_gatt_services) / sizeof(sim_gatt_services[0]); i++) {
+      if (sim_gatt_services[i].uuid == uuid16) {
+        gatt_deliver_service(connection, t, &sim_gatt_services[i]);
+      }
+    }
+  }
+  gatt_complete_at(t + c->interval_ns, connection, 0U);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_discover_characteristics(uint8_t connection,
+                                                uint32_t service)
+{
+  sl_status_t sc;
+  sim_connection_t *c = gatt_begin(connection, &sc);
+  if (c == NULL) {
+    return sc;
+  }
+  uint64_t t = next_connection_event(c, now_ns);
+  uint32_t found = 0;
+  for (size_t i = 0; i < sizeof(sim_gatt_characteristics) / sizeof(sim_gatt_characteristics[0]); i++) {
+    const sim_gatt_characteristic_t *ch = &sim_gatt_characteristics[i];
+    if (ch->service != service) {
+      continue;
+    }
+    sl_bt_msg_t msg = { .header = sl_bt_evt_gatt_characteristic_id };
+    msg.data.evt_gatt_characteristic.connection = connection;
+    msg.data.evt_gatt_characteristic.characteristic = ch->handle;
+    msg.data.evt_gatt_characteristic.properties = ch->properties;
+    msg.data.evt_gatt_characteristic.uuid.len = 2;
+    msg.data.evt_gatt_characteristic.uuid.data[0] = (uint8_t)(ch->uuid & 0xFFU);
+    msg.data.evt_gatt_characteristic.uuid.data[1] = (uint8_t)(ch->uuid >> 8);
+    sim_deliver(SIM_GATEWAY_NODE, t + (found / SIM_CHARS_PER_RESPONSE) * c->interval_ns, &msg);
+    found++;
+  }
+  uint64_t rounds = (found + SIM_CHARS_PER_RESPONSE - 1) / SIM_CHARS_PER_RESPONSE;
+  gatt_complete_at(t + rounds * c->interval_ns, connection, 0U);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_set_characteristic_notification(uint8_t connection,
+                                                       uint16_t characteristic,
+                                                       uint8_t flags)
+{
+  (void)characteristic;
+  (void)flags;
+  sl_status_t sc;
+  sim_connection_t *c = gatt_begin(connection, &sc);
+  if (c == NULL) {
+    return sc;
+  }
+  uint64_t t = next_connection_event(c, now_ns);
+  gatt_complete_at(t + c->interval_ns, connection, 0U);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_write_characteristic_value(uint8_t connection,
+                                                  uint16_t characteristic,
+                                                  size_t value_len,
+                                                  const uint8_t* value)
+{
+  sl_status_t sc;
+  sim_connection_t *c = gatt_begin(connection, &sc);
+  if (c == NULL) {
+    return sc;
+  }
+  uint64_t t = next_connection_event(c, now_ns);
+  const sim_gatt_characteristic_t *ch = NULL;
+  for (size_t i = 0; i < sizeof(sim_gatt_characteristics) / sizeof(sim_gatt_characteristics[0]); i++) {
+    if (sim_gatt_characteristics[i].handle == characteristic) {
+      ch = &sim_gatt_characteristics[i];
+    }
+  }
+  if (ch == NULL || !(ch->properties & SIM_GATT_PROP_WRITE)) {
+    gatt_complete_at(t + c->interval_ns, connection, SIM_ATT_ERROR_BASE | SIM_ATT_WRITE_NOT_PERMITTED);
+    return SL_STATUS_OK;
+  }
+  sl_bt_msg_t msg = { .header = sl_bt_evt_gatt_server_user_write_request_id };
+  msg.data.evt_gatt_server_user_write_request.connection = SIM_PN_CONNECTION_HANDLE;
+  msg.data.evt_gatt_server_user_write_request.characteristic = characteristic;
+  msg.data.evt_gatt_server_user_write_request.att_opcode = sl_bt_gatt_write_request;
+  msg.data.evt_gatt_server_user_write_request.value.len = (uint8_t)value_len;
+  memcpy(msg.data.evt_gatt_server_user_write_request.value.data, value, value_len);
+  sim_deliver(c->peripheral, t, &msg);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_send_user_write_response(uint8_t connection,
+                                                       uint16_t characteristic,
+                                                       uint8_t att_errorcode)
+{
+  (void)characteristic;
+  sim_connection_t *c = connection_of(current_node, connection);
+  if (c == NULL) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  uint64_t result = att_errorcode ? (SIM_ATT_ERROR_BASE | att_errorcode) : 0U;
+  gatt_complete_at(next_connection_event(c, now_ns), gateway_handle_of(c), (uint16_t)result);
+  return SL_STATUS_OK;
+}
+
+
+// -----------------------------------------------------------------------------
+// PAwR advertiser, PAST and PAwR synchronization
+
+static uint64_t pawr_subevent_time(uint64_t event, uint8_t subevent)
+{
+  return pawr.t0_ns + event * pawr.interval_ns + subevent * pawr.subevent_interval_ns;
+}
+
+static uint64_t pawr_arg(uint64_t event, uint8_t subevent)
+{
+  return ((uint64_t)pawr.generation << 48) | ((uint64_t)subevent << 40) | event;
+}
+
+static bool pawr_arg_valid(uint64_t arg)
+{
+  return pawr.started && (uint16_t)(arg >> 48) == pawr.generation;
+}
+
+static void lose_sync(uint8_t node)
+{
+  sim_node_t *n = &nodes[node];
+  n->synced = false;
+  n->num_sync_subevents = 0;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_sync_closed_id };
+  msg.data.evt_sync_closed.reason = SL_STATUS_TIMEOUT;
+  msg.data.evt_sync_closed.sync = SIM_PN_SYNC_HANDLE;
+  sim_deliver(node, now_ns, &msg);
+}
+
+static void pawr_data_request(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  if (!pawr_arg_valid(arg)) {
+    return;
+  }
+  sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_advertiser_subevent_data_request_id };
+  msg.data.evt_pawr_advertiser_subevent_data_request.advertising_set = pawr.advertising_set;
+  msg.data.evt_pawr_advertiser_subevent_data_request.subevent_start = (uint8_t)(arg >> 40);
+  msg.data.evt_pawr_advertiser_subevent_data_request.subevent_data_count = 1;
+  msg.data.evt_pawr_advertiser_subevent_data_request.response_slot_start = 0;
+  msg.data.evt_pawr_advertiser_subevent_data_request.response_slot_count = pawr.response_slots;
+  sim_deliver(SIM_GATEWAY_NODE, now_ns, &msg);
+}
+
+static bool node_listens(const sim_node_t *n, uint64_t event, uint8_t subevent)
+{
+  if (!n->synced || event < n->sync_next_event) {
+    return false;
+  }
+  for (uint8_t i = 0; i < n->num_sync_subevents; i++) {
+    if (n->sync_subevents[i] == subevent) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void pawr_subevent_transmit(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  if (!pawr_arg_valid(arg)) {
+    return;
+  }
+  uint8_t subevent = (uint8_t)(arg >> 40);
+  uint64_t event = arg & 0xFFFFFFFFFFULL;
+  sim_pawr_subevent_t *se = &pawr.subevents[subevent];
+  pawr.event = event;
+  if (se->valid) {
+    radio_capture(SIM_GATEWAY_NODE, PRS_MODEM_SYNCSENT);
+  }
+
+  for (uint8_t i = 1; i <= config.num_peripherals; i++) {
+    sim_node_t *n = &nodes[i];
+    if (!node_listens(n, event, subevent)) {
+      continue;
+    }
+    n->stats.radio_wakeups++;
+    // after a miss the receiver listens to every event until it receives again
+    if (sim_random_unit() < config.loss) {
+      n->sync_next_event = event + 1U;
+      continue;
+    }
+    // an empty subevent follows a received train packet, the skip goes on
+    n->sync_last_rx_ns = now_ns;
+    n->sync_last_rx_event = event;
+    n->sync_next_event = event + n->sync_skip + 1U;
+    if (!se->valid) {
+      continue;
+    }
+    radio_capture(i, PRS_MODEM_FRAMEDET);
+    n->stats.reports_delivered++;
+    sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_sync_subevent_report_id };
+    sl_bt_evt_pawr_sync_subevent_report_t *rep = &msg.data.evt_pawr_sync_subevent_report;
+    rep->sync = SIM_PN_SYNC_HANDLE;
+    rep->tx_power = 0;
+    rep->rssi = -55;
+    rep->cte_type = 0xFF;
+    rep->channel_selection_algorithm = 1;
+    rep->event_counter = (uint16_t)event;
+    rep->subevent = subevent;
+    rep->data_status = 0;
+    rep->data.len = se->len;
+    memcpy(rep->data.data, se->data, se->len);
+    uint64_t airtime = (SIM_PACKET_OVERHEAD_BYTES + se->len) * SIM_BYTE_AIRTIME_NS;
+    sim_deliver(i, now_ns + airtime, &msg);
+  }
+  se->valid = false;
+
+  if (subevent == 0) {
+    for (uint8_t i = 1; i <= config.num_peripherals; i++) {
+      sim_node_t *n = &nodes[i];
+      if (n->synced && now_ns - n->sync_last_rx_ns > (uint64_t)n->sync_timeout * 10U * SIM_NS_PER_MS) {
+        lose_sync(i);
+      }
+    }
+  }
+}
+
+static void pawr_event(uint8_t node, uint64_t arg)
+{
+  (void)node;
+  if (!pawr_arg_valid(arg)) {
+    return;
+  }
+  uint64_t event = arg & 0xFFFFFFFFFFULL;
+  uint64_t lead = (uint64_t)config.pawr_lead_us * SIM_NS_PER_US;
+  for (uint8_t s = 0; s < pawr.num_subevents; s++) {
+    uint64_t t = pawr_subevent_time(event, s);
+    sim_call_at(t - lead, SIM_GATEWAY_NODE, pawr_data_request, pawr_arg(event, s));
+    sim_call_at(t, SIM_GATEWAY_NODE, pawr_subevent_transmit, pawr_arg(event, s));
+  }
+  sim_call_at(pawr_subevent_time(event + 1, 0) - lead, SIM_GATEWAY_NODE, pawr_event, pawr_arg(event + 1, 0));
+}
+
+sl_status_t sl_bt_pawr_advertiser_start(uint8_t advertising_set,
+                                        uint16_t interval_min,
+                                        uint16_t interval_max,
+                                        uint32_t flags,
+                                        uint8_t num_subevents,
+                                        uint8_t subevent_interval,
+                                        uint8_t response_slot_delay,
+                                        uint8_t response_slot_spacing,
+                                        uint8_t response_slots)
+{
+  (void)interval_max;
+  (void)flags;
+  if (interval_min < 0x06U || num_subevents == 0 || num_subevents > SIM_MAX_PAWR_SUBEVENTS
+      || (uint32_t)num_subevents * subevent_interval > interval_min) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  pawr.started = true;
+  pawr.generation++;
+  pawr.advertising_set = advertising_set;
+  pawr.interval_units = interval_min;
+  pawr.num_subevents = num_subevents;
+  pawr.subevent_interval_units = subevent_interval;
+  pawr.response_slot_delay_units = response_slot_delay;
+  pawr.response_slot_spacing_units = response_slot_spacing;
+  pawr.response_slots = response_slots;
+  pawr.interval_ns = (uint64_t)interval_min * 1250U * SIM_NS_PER_US;
+  pawr.subevent_interval_ns = (uint64_t)subevent_interval * 1250U * SIM_NS_PER_US;
+  pawr.response_slot_delay_ns = (uint64_t)response_slot_delay * 1250U * SIM_NS_PER_US;
+  pawr.response_slot_spacing_ns = (uint64_t)response_slot_spacing * 125U * SIM_NS_PER_US;
+  pawr.t0_ns = now_ns + (uint64_t)config.pawr_lead_us * SIM_NS_PER_US + 5 * SIM_NS_PER_MS;
+  pawr.event = 0;
+  memset(pawr.subevents, 0, sizeof(pawr.subevents));
+  sim_call_at(pawr.t0_ns - (uint64_t)config.pawr_lead_us * SIM_NS_PER_US,
+              SIM_GATEWAY_NODE, pawr_event, pawr_arg(0, 0));
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_pawr_advertiser_set_subevent_data(uint8_t advertising_set,
+                                                    uint8_t subevent,
+                                                    uint8_t response_slot_start,
+                                                    uint8_t response_slot_count,
+                                                    size_t adv_data_len,
+                                                    const uint8_t* adv_data)
+{
+  if (!pawr.started || advertising_set != pawr.advertising_set) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  if (subevent >= pawr.num_subevents || adv_data_len > SIM_MAX_PAWR_DATA) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  sim_pawr_subevent_t *se = &pawr.subevents[subevent];
+  se->valid = true;
+  se->response_slot_start = response_slot_start;
+  se->response_slot_count = response_slot_count;
+  se->len = (uint8_t)adv_data_len;
+  memcpy(se->data, adv_data, adv_data_len);
+  return SL_STATUS_OK;
+}
+
+static void sync_established(sim_node_t *n, uint64_t arg, uint16_t skip, uint16_t timeout)
+{
+  n->synced = true;
+  n->sync_skip = skip;
+  n->sync_timeout = timeout;
+  n->num_sync_subevents = 0;
+  n->sync_last_rx_ns = now_ns;
+  n->sync_last_rx_event = arg & 0xFFFFFFFFFFULL;
+  n->sync_next_event = n->sync_last_rx_event;
+  if (!n->stats.synced_ns) {
+    n->stats.synced_ns = now_ns;
+  } else if (n->stats.sync_lost_ns && !n->stats.resynced_ns) {
+    n->stats.resynced_ns = now_ns;
+  }
+}
+
+static void past_sync_established(uint8_t node, uint64_t arg)
+{
+  sim_node_t *n = &nodes[node];
+  // a second transfer of a train already synchronized to is ignored
+  if (!pawr_arg_valid(arg) || n->synced) {
+    return;
+  }
+  sync_established(n, arg, n->past_skip, n->past_timeout);
+  sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_sync_transfer_received_id };
+  sl_bt_evt_pawr_sync_transfer_received_t *rx = &msg.data.evt_pawr_sync_transfer_received;
+  rx->status = SL_STATUS_OK;
+  rx->sync = SIM_PN_SYNC_HANDLE;
+  rx->connection = SIM_PN_CONNECTION_HANDLE;
+  rx->adv_sid = 0;
+  rx->address = nodes[SIM_GATEWAY_NODE].address;
+  rx->adv_phy = sl_bt_gap_phy_1m;
+  rx->adv_interval = pawr.interval_units;
+  rx->clock_accuracy = 50;
+  rx->num_subevents = pawr.num_subevents;
+  rx->subevent_interval = pawr.subevent_interval_units;
+  rx->response_slot_delay = pawr.response_slot_delay_units;
+  rx->response_slot_spacing = pawr.response_slot_spacing_units;
+  sim_deliver(node, now_ns, &msg);
+}
+
+static void past_received(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  sim_node_t *n = &nodes[node];
+  if (n->past_mode != sl_bt_past_receiver_mode_synchronize || !pawr.started) {
+    return;
+  }
+  // synchronization is reported once the next periodic packet is received
+  uint64_t event = (now_ns > pawr.t0_ns) ? (now_ns - pawr.t0_ns) / pawr.interval_ns + 1U : 0U;
+  sim_call_at(pawr_subevent_time(event, 0), node, past_sync_established, pawr_arg(event, 0));
+}
+
+// The sync scanner opens the train at the next periodic event after it
+// received the SyncInfo of the extended advertising
+static void scanner_sync_established(uint8_t node, uint64_t arg)
+{
+  sim_node_t *n = &nodes[node];
+  if (!pawr_arg_valid(arg) || !n->sync_pending || n->powered_off) {
+    return;
+  }
+  n->sync_pending = false;
+  sync_established(n, arg, n->sync_scan_skip, n->sync_scan_timeout);
+  sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_sync_opened_id };
+  sl_bt_evt_pawr_sync_opened_t *op = &msg.data.evt_pawr_sync_opened;
+  op->sync = SIM_PN_SYNC_HANDLE;
+  op->adv_sid = 0;
+  op->address = nodes[SIM_GATEWAY_NODE].address;
+  op->address_type = sl_bt_gap_public_address;
+  op->adv_phy = sl_bt_gap_phy_1m;
+  op->sec_phy = sl_bt_gap_phy_1m;
+  op->adv_interval = pawr.interval_units;
+  op->clock_accuracy = 50;
+  op->num_subevents = pawr.num_subevents;
+  op->subevent_interval = pawr.subevent_interval_units;
+  op->response_slot_delay = pawr.response_slot_delay_units;
+  op->response_slot_spacing = pawr.response_slot_spacing_units;
+  sim_deliver(node, now_ns, &msg);
+}
+
+static void sync_info_received(uint8_t node, uint64_t arg)
+{
+  (void)arg;
+  sim_node_t *n = &nodes[node];
+  if (!n->sync_pending || n->powered_off) {
+    return;
+  }
+  uint64_t interval = pawr.sync_info ? pawr.sync_info_interval_ns : SIM_ADV_INTERVAL_NS;
+  if (!pawr.started || !pawr.sync_info || !n->scanning || sim_random_unit() < config.loss) {
+    sim_call_at(now_ns + interval, node, sync_info_received, 0);
+    return;
+  }
+  uint64_t event = (now_ns > pawr.t0_ns) ? (now_ns - pawr.t0_ns) / pawr.interval_ns + 1U : 0U;
+  sim_call_at(pawr_subevent_time(event, 0), node, scanner_sync_established, pawr_arg(event, 0));
+}
+
+sl_status_t sl_bt_sync_scanner_set_sync_parameters(uint16_t skip,
+                                                  uint16_t timeout,
+                                                  uint8_t reporting_mode)
+{
+  (void)reporting_mode;
+  nodes[current_node].sync_scan_skip = skip;
+  nodes[current_node].sync_scan_timeout = timeout;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_sync_scanner_open(bd_addr address,
+                                    uint8_t address_type,
+                                    uint8_t adv_sid,
+                                    uint16_t *sync)
+{
+  (void)address_type;
+  (void)adv_sid;
+  sim_node_t *n = &nodes[current_node];
+  if (n->synced || n->sync_pending) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  n->sync_pending = true;
+  *sync = SIM_PN_SYNC_HANDLE;
+  // an unknown advertiser is never found, the sync stays pending
+  if (memcmp(address.addr, nodes[SIM_GATEWAY_NODE].address.addr, sizeof(address.addr)) == 0) {
+    uint64_t interval = pawr.sync_info ? pawr.sync_info_interval_ns : SIM_ADV_INTERVAL_NS;
+    sim_call_at(now_ns + (uint64_t)(sim_random_unit() * interval), current_node, sync_info_received, 0);
+  }
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_past_transfer(uint8_t connection,
+                                           uint16_t service_data,
+                                           uint8_t advertising_set)
+{
+  (void)service_data;
+  sim_connection_t *c = connection_of(current_node, connection);
+  if (c == NULL) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  if (!pawr.started || advertising_set != pawr.advertising_set) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  sim_call_at(next_connection_event(c, now_ns), c->peripheral, past_received, 0);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_past_receiver_set_sync_receive_parameters(uint8_t connection,
+                                                            uint8_t mode,
+                                                            uint16_t skip,
+                                                            uint16_t timeout,
+                                                            uint8_t reporting_mode)
+{
+  (void)reporting_mode;
+  if (connection_of(current_node, connection) == NULL) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  sim_node_t *n = &nodes[current_node];
+  n->past_mode = mode;
+  n->past_skip = skip;
+  n->past_timeout = timeout;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_sync_update_sync_parameters(uint16_t sync,
+                                              uint16_t skip,
+                                              uint16_t timeout)
+{
+  sim_node_t *n = &nodes[current_node];
+  if (!n->synced || sync != SIM_PN_SYNC_HANDLE) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  // a new skip applies from the last received event, unless one was missed since
+  if (n->sync_next_event == n->sync_last_rx_event + n->sync_skip + 1U) {
+    n->sync_next_event = n->sync_last_rx_event + skip + 1U;
+  }
+  n->sync_skip = skip;
+  n->sync_timeout = timeout;
+  return SL_STATUS_OK;
+}
+
+static void pawr_response(uint8_t node, uint64_t arg)
+{
+  sim_node_t *n = &nodes[node];
+  if (!pawr_arg_valid(arg) || n->powered_off || !n->synced) {
+    return;
+  }
+  if (sim_random_unit() < config.loss) {
+    return;
+  }
+  n->stats.responses_delivered++;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_pawr_advertiser_response_report_id };
+  sl_bt_evt_pawr_advertiser_response_report_t *rep = &msg.data.evt_pawr_advertiser_response_report;
+  rep->advertising_set = pawr.advertising_set;
+  rep->subevent = n->response_subevent;
+  rep->tx_power = 0;
+  rep->rssi = -55;
+  rep->cte_type = 0xFF;
+  rep->channel_selection_algorithm = 1;
+  rep->response_slot = n->response_slot;
+  rep->data_status = 0;
+  rep->data.len = n->response_len;
+  memcpy(rep->data.data, n->response_data, n->response_len);
+  uint64_t airtime = (SIM_PACKET_OVERHEAD_BYTES + n->response_len) * SIM_BYTE_AIRTIME_NS;
+  sim_deliver(SIM_GATEWAY_NODE, now_ns + airtime, &msg);
+}
+
+sl_status_t sl_bt_pawr_sync_set_response_data(uint16_t sync,
+                                              uint16_t request_event,
+                                              uint8_t request_subevent,
+                                              uint8_t response_subevent,
+                                              uint8_t response_slot,
+                                              size_t response_data_len,
+                                              const uint8_t* response_data)
+{
+  sim_node_t *n = &nodes[current_node];
+  if (!n->synced || sync != SIM_PN_SYNC_HANDLE) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  if (response_subevent >= pawr.num_subevents || response_slot >= pawr.response_slots
+      || response_data_len > SIM_MAX_PAWR_DATA) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  // reconstruct the full event counter from its lower 16 bits
+  uint64_t event = pawr.event - (uint16_t)((uint16_t)pawr.event - request_event);
+  uint64_t t = pawr_subevent_time(event, request_subevent) + pawr.response_slot_delay_ns
+               + response_slot * pawr.response_slot_spacing_ns;
+  if (t <= now_ns) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  n->response_subevent = response_subevent;
+  n->response_slot = response_slot;
+  n->response_len = (uint8_t)response_data_len;
+  memcpy(n->response_data, response_data, response_data_len);
+  sim_call_at(t, current_node, pawr_response, pawr_arg(event, response_subevent));
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_sync_close(uint16_t sync)
+{
+  sim_node_t *n = &nodes[current_node];
+  if (!(n->synced || n->sync_pending) || sync != SIM_PN_SYNC_HANDLE) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  n->synced = false;
+  n->sync_pending = false;
+  n->num_sync_subevents = 0;
+  sl_bt_msg_t msg = { .header = sl_bt_evt_sync_closed_id };
+  msg.data.evt_sync_closed.reason = SL_STATUS_OK;
+  msg.data.evt_sync_closed.sync = sync;
+  sim_deliver(current_node, now_ns, &msg);
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_pawr_sync_set_sync_subevents(uint16_t sync,
+                                               size_t subevents_len,
+                                               const uint8_t* subevents)
+{
+  sim_node_t *n = &nodes[current_node];
+  if (!n->synced || sync != SIM_PN_SYNC_HANDLE) {
+    return SL_STATUS_INVALID_HANDLE;
+  }
+  if (subevents_len > SIM_MAX_SYNC_SUBEVENTS) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  memcpy(n->sync_subevents, subevents, subevents_len);
+  n->num_sync_subevents = (uint8_t)subevents_len;
+  return SL_STATUS_OK;
+}
+
+static sim_nvm3_object_t *nvm3_find_object(nvm3_ObjectKey_t key)
+{
+  for (uint8_t i = 0; i < SIM_MAX_NVM3_OBJECTS; i++) {
+    if (nvm3_objects[i].used && nvm3_objects[i].node == current_node && nvm3_objects[i].key == key) {
+      return &nvm3_objects[i];
+    }
+  }
+  return NULL;
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len)
+{
+  (void)h;
+  sim_nvm3_object_t *obj = nvm3_find_object(key);
+  if (obj == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  if (obj->len != len) {
+    return ECODE_NVM3_ERR_READ_DATA_SIZE;
+  }
+  memcpy(value, obj->data, len);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len)
+{
+  (void)h;
+  sim_nvm3_object_t *obj = nvm3_find_object(key);
+  for (uint8_t i = 0; obj == NULL && i < SIM_MAX_NVM3_OBJECTS; i++) {
+    if (!nvm3_objects[i].used) {
+      obj = &nvm3_objects[i];
+    }
+  }
+  if (obj == NULL || len > SIM_MAX_NVM3_OBJECT_SIZE) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  obj->used = true;
+  obj->node = current_node;
+  obj->key = key;
+  obj->len = len;
+  memcpy(obj->data, value, len);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key)
+{
+  (void)h;
+  sim_nvm3_object_t *obj = nvm3_find_object(key);
+  if (obj == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  obj->used = false;
+  return ECODE_NVM3_OK;
+}
@@ -0,0 +1,86 @@
+/*
+ * sim_stack.h
+ *
+ *  Discrete-event model of the Bluetooth stack and sleeptimer used by the
+ *  host simulator. Node 0 is the gateway, nodes 1..N are peripherals.
+ *  All times are virtual nanoseconds measured by an ideal reference clock.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SIM_STACK_H_
+#define SIM_STACK_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#ifndef SIM_MAX_PERIPHERALS
+#define SIM_MAX_PERIPHERALS               16
+#endif
+#define SIM_MAX_NODES                     (SIM_MAX_PERIPHERALS + 1)
+#define SIM_GATEWAY_NODE                  0
+#define SIM_NS_PER_US                     1000ULL
+#define SIM_NS_PER_MS                     1000000ULL
+#define SIM_NS_PER_S                      1000000000ULL
+#define SIM_TIMER_FREQUENCY               32768U
+
+typedef void (*sim_event_handler_t)(sl_bt_msg_t *evt);
+typedef void (*sim_call_t)(uint8_t node, uint64_t arg);
+
+typedef struct sim_node_config_t {
+  double   ppm;                 // crystal error of the sleeptimer clock
+  uint32_t latency_us;          // fixed part of the event-delivery latency
+  uint32_t jitter_us;           // uniformly distributed extra latency
+  uint32_t boot_ms;             // virtual time of the system boot event
+} sim_node_config_t;
+
+typedef struct sim_config_t {
+  uint8_t           num_peripherals;
+  uint32_t          seed;
+  uint32_t          conn_interval_us;   // connection interval of every link
+  uint32_t          pawr_lead_us;       // subevent data request lead time
+  double            loss;               // PAwR packet error rate
+  uint64_t          tick_base;          // sleeptimer of every node at boot, plus up to 2^24
+  int               log_level;
+  sim_node_config_t gateway;
+  sim_node_config_t peripherals[SIM_MAX_PERIPHERALS];
+} sim_config_t;
+
+typedef struct sim_node_stats_t {
+  uint64_t boot_ns;
+  uint64_t connected_ns;        // first connection opened
+  uint64_t synced_ns;           // first PAwR sync established (PAST)
+  uint64_t sync_lost_ns;        // last forced loss of the PAwR sync
+  uint64_t resynced_ns;         // PAwR sync established again after the loss
+  uint32_t radio_wakeups;       // PAwR subevents the receiver listened to
+  uint32_t reports_delivered;
+  uint32_t responses_delivered;
+} sim_node_stats_t;
+
+void     sim_init(const sim_config_t *config);
+void     sim_set_handler(uint8_t node, sim_event_handler_t handler);
+void     sim_run(uint64_t until_ns);
+uint64_t sim_now_ns(void);
+uint8_t  sim_current_node(void);
+void     sim_set_current_node(uint8_t node);
+void     sim_call_at(uint64_t t_ns, uint8_t node, sim_call_t fn, uint64_t arg);
+
+uint64_t sim_node_tick64(uint8_t node);
+void     sim_node_override_tick(uint8_t node, bool enable, uint64_t tick);
+bool     sim_node_is_synced(uint8_t node);
+void     sim_node_force_sync(uint8_t node);
+void     sim_node_leave(uint8_t node);
+void     sim_node_drop_sync(uint8_t node);
+// Latches the SYSRTC capture of the node at the given tick, as the radio
+// signal routed to it through PRS does
+void     sim_node_capture(uint8_t node, uint64_t tick);
+const sim_node_stats_t *sim_node_stats(uint8_t node);
+// Peripheral at the other end of a gateway connection, SIM_GATEWAY_NODE if none
+uint8_t  sim_connection_peripheral(uint8_t connection);
+
+void     sim_deliver(uint8_t node, uint64_t t_ns, const sl_bt_msg_t *msg);
+uint32_t sim_random(void);
+double   sim_random_unit(void);
+
+#endif /* SIM_STACK_H_ */
@@ -0,0 +1,27 @@
+/*
+ * app_assert.h
+ *
+ *  Host simulator stand-in for the app_assert component. A failed assertion
+ *  aborts the simulation with the node, file and line that raised it.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef APP_ASSERT_H_
+#define APP_ASSERT_H_
+#include "sl_status.h"
+
+void sim_assert_failed(const char *file, int line, const char *expr) __attribute__((noreturn));
+
+#define app_assert(expr, ...)                                        \
+  do {                                                               \
+    if (!(expr)) {                                                   \
+      sim_assert_failed(__FILE__, __LINE__, #expr);                  \
+    }                                                                \
+  } while (0)
+
+#define app_assert_status(sc)           app_assert((sc) == SL_STATUS_OK)
+#define app_assert_status_f(sc, ...)    app_assert((sc) == SL_STATUS_OK)
+
+#endif /* APP_ASSERT_H_ */
@@ -0,0 +1,29 @@
+/*
+ * app_log.h
+ *
+ *  Host simulator stand-in for the app_log component. Log lines are
+ *  prefixed with the simulated node that emitted them.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef APP_LOG_H_
+#define APP_LOG_H_
+
+#define APP_LOG_NL                      "\n"
+#define APP_LOG_LEVEL_DEBUG             4
+#define APP_LOG_LEVEL_INFO              3
+#define APP_LOG_LEVEL_WARNING           2
+#define APP_LOG_LEVEL_ERROR             1
+#define APP_LOG_LEVEL_NONE              0
+
+void sim_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define app_log(...)                    sim_log(APP_LOG_LEVEL_INFO, __VA_ARGS__)
+#define app_log_debug(...)              sim_log(APP_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define app_log_info(...)               sim_log(APP_LOG_LEVEL_INFO, __VA_ARGS__)
+#define app_log_warning(...)            sim_log(APP_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define app_log_error(...)              sim_log(APP_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif /* APP_LOG_H_ */
@@ -0,0 +1,25 @@
+/*
+ * em_core.h
+ *
+ *  Host simulator stand-in for the EMLIB CORE critical section API. The
+ *  simulator is single threaded, so atomic sections compile to plain blocks
+ *  and the memory barrier CMSIS provides on the target only stops the
+ *  compiler from reordering.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef EM_CORE_H_
+#define EM_CORE_H_
+
+#define CORE_DECLARE_IRQ_STATE          int sim_irq_state_ = 0
+#define CORE_ENTER_ATOMIC()             (void)sim_irq_state_
+#define CORE_EXIT_ATOMIC()              (void)sim_irq_state_
+#define CORE_ENTER_CRITICAL()           (void)sim_irq_state_
+#define CORE_EXIT_CRITICAL()            (void)sim_irq_state_
+#define CORE_ATOMIC_SECTION(yourcode)   { yourcode }
+#define CORE_CRITICAL_SECTION(yourcode) { yourcode }
+#define __DMB()                         __asm__ volatile ("" ::: "memory")
+
+#endif /* EM_CORE_H_ */
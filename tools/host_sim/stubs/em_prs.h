@@ -0,0 +1,36 @@
+/*
+ * em_prs.h
+ *
+ *  Host simulator stand-in for the EMLIB PRS API. A node connects one radio
+ *  signal to the SYSRTC capture, the simulator latches its sleeptimer when
+ *  that signal fires.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef EM_PRS_H_
+#define EM_PRS_H_
+
+#define PRS_MODEM_FRAMEDET              0x0501U
+#define PRS_MODEM_SYNCSENT              0x0502U
+
+typedef enum {
+  prsTypeAsync,
+  prsTypeSync
+} PRS_ChType_t;
+
+typedef enum {
+  prsSignalNone = 0
+} PRS_Signal_t;
+
+typedef enum {
+  prsConsumerNone,
+  prsConsumerSYSRTC0_SRC0
+} PRS_Consumer_t;
+
+int  PRS_GetFreeChannel(PRS_ChType_t type);
+void PRS_ConnectSignal(unsigned int ch, PRS_ChType_t type, PRS_Signal_t signal);
+void PRS_ConnectConsumer(unsigned int ch, PRS_ChType_t type, PRS_Consumer_t consumer);
+
+#endif /* EM_PRS_H_ */
@@ -0,0 +1,33 @@
+/*
+ * nvm3.h
+ *
+ *  Host simulator stand-in for the NVM3 data storage driver. Objects are kept
+ *  in memory for the lifetime of the simulation, i.e. they survive a reboot
+ *  of the simulated node.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef NVM3_H_
+#define NVM3_H_
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t Ecode_t;
+typedef uint32_t nvm3_ObjectKey_t;
+
+typedef struct nvm3_Handle {
+  uint8_t owner;                // simulated node owning the storage
+} nvm3_Handle_t;
+
+#define ECODE_NVM3_OK                       0x00000000U
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND        0xF000E021U
+#define ECODE_NVM3_ERR_STORAGE_FULL         0xF000E022U
+#define ECODE_NVM3_ERR_READ_DATA_SIZE       0xF000E01EU
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+
+#endif /* NVM3_H_ */
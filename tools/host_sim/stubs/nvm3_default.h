@@ -0,0 +1,16 @@
+/*
+ * nvm3_default.h
+ *
+ *  Host simulator stand-in for the default NVM3 instance.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef NVM3_DEFAULT_H_
+#define NVM3_DEFAULT_H_
+#include "nvm3.h"
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+#endif /* NVM3_DEFAULT_H_ */
@@ -0,0 +1,35 @@
+/*
+ * peripheral_sysrtc.h
+ *
+ *  Host simulator stand-in for the SYSRTC peripheral driver, group 0 of the
+ *  sleeptimer counter with its capture channel. Every simulated node has its
+ *  own registers.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef PERIPHERAL_SYSRTC_H_
+#define PERIPHERAL_SYSRTC_H_
+#include <stdint.h>
+
+#define SYSRTC_GRP0_CTRL_CAP0EN           0x00000004UL
+#define SYSRTC_GRP0_CTRL_CAP0EDGE_RISING  0x00000000UL
+#define SYSRTC_GRP0_IF_CAP0               0x00000008UL
+
+typedef struct {
+  volatile uint32_t GRP0_IF;
+  volatile uint32_t GRP0_CTRL;
+  volatile uint32_t GRP0_CAP0VALUE;
+} SYSRTC_TypeDef;
+
+SYSRTC_TypeDef *sim_sysrtc(void);
+#define SYSRTC0                           (sim_sysrtc())
+
+void     sl_sysrtc_unlock(void);
+void     sl_sysrtc_lock(void);
+uint32_t sl_sysrtc_get_group_interrupts(uint8_t group_number);
+void     sl_sysrtc_clear_group_interrupts(uint8_t group_number, uint32_t flags);
+uint32_t sl_sysrtc_get_group_capture_channel_value(uint8_t group_number);
+
+#endif /* PERIPHERAL_SYSRTC_H_ */
@@ -0,0 +1,442 @@
+/*
+ * sl_bluetooth.h
+ *
+ *  Host simulator stand-in for the Bluetooth stack API. It declares the
+ *  subset of sl_bt_* commands and events used by the BLE Time Sync library
+ *  with the same names, argument lists and event fields as the Gecko SDK,
+ *  so the library sources compile unchanged against tools/host_sim.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SL_BLUETOOTH_H_
+#define SL_BLUETOOTH_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "em_core.h"
+#include "sl_sleeptimer.h"
+#include "sl_status.h"
+
+#ifndef SL_BT_CONFIG_MAX_CONNECTIONS
+#define SL_BT_CONFIG_MAX_CONNECTIONS              4
+#endif
+
+#define SL_BGAPI_MAX_PAYLOAD_SIZE                 256
+#define SL_BT_MSG_ID(HDR)                         (HDR)
+
+#define SL_BT_INVALID_CONNECTION_HANDLE           ((uint8_t)0xFF)
+#define SL_BT_INVALID_SYNC_HANDLE                 ((uint16_t)0xFFFF)
+#define SL_BT_INVALID_ADVERTISING_SET_HANDLE      ((uint8_t)0xFF)
+
+#define SL_BT_SCANNER_EVENT_FLAG_CONNECTABLE      0x01
+#define SL_BT_SCANNER_EVENT_FLAG_SCANNABLE        0x02
+#define SL_BT_SCANNER_EVENT_FLAG_DIRECTED         0x04
+#define SL_BT_SCANNER_EVENT_FLAG_SCAN_RESPONSE    0x08
+
+typedef struct {
+  uint8_t addr[6];
+} bd_addr;
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[];
+} uint8array;
+
+typedef enum {
+  sl_bt_gap_public_address        = 0x0,
+  sl_bt_gap_static_address        = 0x1,
+} sl_bt_gap_address_type_t;
+
+typedef enum {
+  sl_bt_gap_phy_1m                = 0x1,
+  sl_bt_gap_phy_2m                = 0x2,
+  sl_bt_gap_phy_coded             = 0x4,
+} sl_bt_gap_phy_t;
+
+typedef enum {
+  sl_bt_scanner_scan_phy_1m       = 0x1,
+  sl_bt_scanner_scan_phy_coded    = 0x4,
+} sl_bt_scanner_scan_phy_t;
+
+typedef enum {
+  sl_bt_scanner_discover_limited      = 0x0,
+  sl_bt_scanner_discover_generic      = 0x1,
+  sl_bt_scanner_discover_observation  = 0x2,
+} sl_bt_scanner_discover_mode_t;
+
+typedef enum {
+  sl_bt_scanner_scan_mode_passive     = 0x0,
+  sl_bt_scanner_scan_mode_active      = 0x1,
+} sl_bt_scanner_scan_mode_t;
+
+typedef enum {
+  sl_bt_advertiser_non_discoverable     = 0x0,
+  sl_bt_advertiser_limited_discoverable = 0x1,
+  sl_bt_advertiser_general_discoverable = 0x2,
+} sl_bt_advertiser_discovery_mode_t;
+
+typedef enum {
+  sl_bt_advertiser_non_connectable          = 0x0,
+  sl_bt_advertiser_connectable_scannable    = 0x2,
+  sl_bt_advertiser_scannable_non_connectable = 0x3,
+} sl_bt_advertiser_connection_mode_t;
+
+typedef enum {
+  sl_bt_extended_advertiser_non_connectable = 0x0,
+  sl_bt_extended_advertiser_scannable       = 0x3,
+  sl_bt_extended_advertiser_connectable     = 0x4,
+} sl_bt_extended_advertiser_connection_mode_t;
+
+typedef enum {
+  sl_bt_past_receiver_mode_ignore       = 0x0,
+  sl_bt_past_receiver_mode_synchronize  = 0x1,
+} sl_bt_past_receiver_mode_t;
+
+typedef enum {
+  sl_bt_sync_report_none  = 0x0,
+  sl_bt_sync_report_all   = 0x1,
+} sl_bt_sync_reporting_mode_t;
+
+typedef enum {
+  sl_bt_gatt_write_request      = 0x12,
+  sl_bt_gatt_write_command      = 0x52,
+} sl_bt_gatt_att_opcode_t;
+
+typedef enum {
+  sl_bt_gatt_disable      = 0x0,
+  sl_bt_gatt_notification = 0x1,
+  sl_bt_gatt_indication   = 0x2,
+} sl_bt_gatt_client_config_flag_t;
+
+#define PACKSTRUCT(decl)                decl __attribute__((__packed__))
+
+PACKSTRUCT(struct sl_bt_evt_system_boot_s {
+  uint16_t major;
+  uint16_t minor;
+  uint16_t patch;
+  uint16_t build;
+  uint32_t bootloader;
+  uint16_t hw;
+  uint32_t hash;
+});
+typedef struct sl_bt_evt_system_boot_s sl_bt_evt_system_boot_t;
+
+PACKSTRUCT(struct sl_bt_evt_system_external_signal_s {
+  uint32_t extsignals;
+});
+typedef struct sl_bt_evt_system_external_signal_s sl_bt_evt_system_external_signal_t;
+
+PACKSTRUCT(struct sl_bt_evt_scanner_legacy_advertisement_report_s {
+  uint8_t    event_flags;
+  bd_addr    address;
+  uint8_t    address_type;
+  uint8_t    bonding;
+  int8_t     rssi;
+  uint8_t    channel;
+  bd_addr    target_address;
+  uint8_t    target_address_type;
+  uint8array data;
+});
+typedef struct sl_bt_evt_scanner_legacy_advertisement_report_s sl_bt_evt_scanner_legacy_advertisement_report_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_opened_s {
+  bd_addr address;
+  uint8_t address_type;
+  uint8_t master;
+  uint8_t connection;
+  uint8_t bonding;
+  uint8_t advertiser;
+  uint16_t sync;
+});
+typedef struct sl_bt_evt_connection_opened_s sl_bt_evt_connection_opened_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_parameters_s {
+  uint8_t  connection;
+  uint16_t interval;
+  uint16_t latency;
+  uint16_t timeout;
+  uint8_t  security_mode;
+  uint16_t txsize;
+});
+typedef struct sl_bt_evt_connection_parameters_s sl_bt_evt_connection_parameters_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_closed_s {
+  uint16_t reason;
+  uint8_t  connection;
+});
+typedef struct sl_bt_evt_connection_closed_s sl_bt_evt_connection_closed_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_service_s {
+  uint8_t    connection;
+  uint32_t   service;
+  uint8array uuid;
+});
+typedef struct sl_bt_evt_gatt_service_s sl_bt_evt_gatt_service_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_characteristic_s {
+  uint8_t    connection;
+  uint16_t   characteristic;
+  uint8_t    properties;
+  uint8array uuid;
+});
+typedef struct sl_bt_evt_gatt_characteristic_s sl_bt_evt_gatt_characteristic_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_characteristic_value_s {
+  uint8_t    connection;
+  uint16_t   characteristic;
+  uint8_t    att_opcode;
+  uint16_t   offset;
+  uint8array value;
+});
+typedef struct sl_bt_evt_gatt_characteristic_value_s sl_bt_evt_gatt_characteristic_value_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_procedure_completed_s {
+  uint8_t  connection;
+  uint16_t result;
+});
+typedef struct sl_bt_evt_gatt_procedure_completed_s sl_bt_evt_gatt_procedure_completed_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_server_attribute_value_s {
+  uint8_t    connection;
+  uint16_t   attribute;
+  uint8_t    att_opcode;
+  uint16_t   offset;
+  uint8array value;
+});
+typedef struct sl_bt_evt_gatt_server_attribute_value_s sl_bt_evt_gatt_server_attribute_value_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_server_user_write_request_s {
+  uint8_t    connection;
+  uint16_t   characteristic;
+  uint8_t    att_opcode;
+  uint16_t   offset;
+  uint8array value;
+});
+typedef struct sl_bt_evt_gatt_server_user_write_request_s sl_bt_evt_gatt_server_user_write_request_t;
+
+PACKSTRUCT(struct sl_bt_evt_pawr_advertiser_subevent_data_request_s {
+  uint8_t advertising_set;
+  uint8_t subevent_start;
+  uint8_t subevent_data_count;
+  uint8_t response_slot_start;
+  uint8_t response_slot_count;
+});
+typedef struct sl_bt_evt_pawr_advertiser_subevent_data_request_s sl_bt_evt_pawr_advertiser_subevent_data_request_t;
+
+PACKSTRUCT(struct sl_bt_evt_pawr_advertiser_response_report_s {
+  uint8_t    advertising_set;
+  uint8_t    subevent;
+  int8_t     tx_power;
+  int8_t     rssi;
+  uint8_t    cte_type;
+  uint8_t    channel_selection_algorithm;
+  uint8_t    response_slot;
+  uint8_t    data_status;
+  uint8array data;
+});
+typedef struct sl_bt_evt_pawr_advertiser_response_report_s sl_bt_evt_pawr_advertiser_response_report_t;
+
+PACKSTRUCT(struct sl_bt_evt_pawr_sync_transfer_received_s {
+  uint16_t status;
+  uint16_t sync;
+  uint16_t service_data;
+  uint8_t  connection;
+  uint8_t  adv_sid;
+  bd_addr  address;
+  uint8_t  address_type;
+  uint8_t  adv_phy;
+  uint16_t adv_interval;
+  uint16_t clock_accuracy;
+  uint8_t  num_subevents;
+  uint8_t  subevent_interval;
+  uint8_t  response_slot_delay;
+  uint8_t  response_slot_spacing;
+});
+typedef struct sl_bt_evt_pawr_sync_transfer_received_s sl_bt_evt_pawr_sync_transfer_received_t;
+
+PACKSTRUCT(struct sl_bt_evt_pawr_sync_opened_s {
+  uint16_t sync;
+  uint8_t  adv_sid;
+  bd_addr  address;
+  uint8_t  address_type;
+  uint8_t  adv_phy;
+  uint8_t  sec_phy;
+  uint16_t adv_interval;
+  uint16_t clock_accuracy;
+  uint8_t  num_subevents;
+  uint8_t  subevent_interval;
+  uint8_t  response_slot_delay;
+  uint8_t  response_slot_spacing;
+});
+typedef struct sl_bt_evt_pawr_sync_opened_s sl_bt_evt_pawr_sync_opened_t;
+
+PACKSTRUCT(struct sl_bt_evt_pawr_sync_subevent_report_s {
+  uint16_t   sync;
+  int8_t     tx_power;
+  int8_t     rssi;
+  uint8_t    cte_type;
+  uint8_t    channel_selection_algorithm;
+  uint16_t   event_counter;
+  uint8_t    subevent;
+  uint8_t    data_status;
+  uint8array data;
+});
+typedef struct sl_bt_evt_pawr_sync_subevent_report_s sl_bt_evt_pawr_sync_subevent_report_t;
+
+PACKSTRUCT(struct sl_bt_evt_sync_closed_s {
+  uint16_t reason;
+  uint16_t sync;
+});
+typedef struct sl_bt_evt_sync_closed_s sl_bt_evt_sync_closed_t;
+
+#define sl_bt_evt_system_boot_id                          0x000000a0
+#define sl_bt_evt_system_external_signal_id               0x030100a0
+#define sl_bt_evt_scanner_legacy_advertisement_report_id  0x000005a0
+#define sl_bt_evt_connection_opened_id                    0x000006a0
+#define sl_bt_evt_connection_parameters_id                0x010006a0
+#define sl_bt_evt_connection_closed_id                    0x010106a0
+#define sl_bt_evt_gatt_service_id                         0x010009a0
+#define sl_bt_evt_gatt_characteristic_id                  0x020009a0
+#define sl_bt_evt_gatt_characteristic_value_id            0x040009a0
+#define sl_bt_evt_gatt_procedure_completed_id             0x060009a0
+#define sl_bt_evt_gatt_server_attribute_value_id          0x00000aa0
+#define sl_bt_evt_gatt_server_user_write_request_id       0x02000aa0
+#define sl_bt_evt_pawr_advertiser_subevent_data_request_id 0x00004ea0
+#define sl_bt_evt_pawr_advertiser_response_report_id      0x01004ea0
+#define sl_bt_evt_pawr_sync_opened_id                     0x00004fa0
+#define sl_bt_evt_pawr_sync_transfer_received_id          0x01004fa0
+#define sl_bt_evt_pawr_sync_subevent_report_id            0x02004fa0
+#define sl_bt_evt_sync_closed_id                          0x010042a0
+
+typedef struct {
+  uint32_t header;
+  union {
+    uint8_t handle;
+    sl_bt_evt_system_boot_t                           evt_system_boot;
+    sl_bt_evt_system_external_signal_t                evt_system_external_signal;
+    sl_bt_evt_scanner_legacy_advertisement_report_t   evt_scanner_legacy_advertisement_report;
+    sl_bt_evt_connection_opened_t                     evt_connection_opened;
+    sl_bt_evt_connection_parameters_t                 evt_connection_parameters;
+    sl_bt_evt_connection_closed_t                     evt_connection_closed;
+    sl_bt_evt_gatt_service_t                          evt_gatt_service;
+    sl_bt_evt_gatt_characteristic_t                   evt_gatt_characteristic;
+    sl_bt_evt_gatt_characteristic_value_t             evt_gatt_characteristic_value;
+    sl_bt_evt_gatt_procedure_completed_t              evt_gatt_procedure_completed;
+    sl_bt_evt_gatt_server_attribute_value_t           evt_gatt_server_attribute_value;
+    sl_bt_evt_gatt_server_user_write_request_t        evt_gatt_server_user_write_request;
+    sl_bt_evt_pawr_advertiser_subevent_data_request_t evt_pawr_advertiser_subevent_data_request;
+    sl_bt_evt_pawr_advertiser_response_report_t       evt_pawr_advertiser_response_report;
+    sl_bt_evt_pawr_sync_opened_t                      evt_pawr_sync_opened;
+    sl_bt_evt_pawr_sync_transfer_received_t           evt_pawr_sync_transfer_received;
+    sl_bt_evt_pawr_sync_subevent_report_t             evt_pawr_sync_subevent_report;
+    sl_bt_evt_sync_closed_t                           evt_sync_closed;
+    uint8_t payload[SL_BGAPI_MAX_PAYLOAD_SIZE];
+  } data;
+} sl_bt_msg_t;
+
+// System
+sl_status_t sl_bt_external_signal(uint32_t signals);
+
+// Advertiser
+sl_status_t sl_bt_advertiser_create_set(uint8_t *advertising_set);
+sl_status_t sl_bt_advertiser_set_timing(uint8_t advertising_set,
+                                        uint32_t interval_min,
+                                        uint32_t interval_max,
+                                        uint16_t duration,
+                                        uint8_t maxevents);
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t advertising_set,
+                                                  uint8_t discover);
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t advertising_set,
+                                          uint8_t connect);
+sl_status_t sl_bt_advertiser_past_transfer(uint8_t connection,
+                                           uint16_t service_data,
+                                           uint8_t advertising_set);
+
+// PAwR advertiser
+sl_status_t sl_bt_pawr_advertiser_start(uint8_t advertising_set,
+                                        uint16_t interval_min,
+                                        uint16_t interval_max,
+                                        uint32_t flags,
+                                        uint8_t num_subevents,
+                                        uint8_t subevent_interval,
+                                        uint8_t response_slot_delay,
+                                        uint8_t response_slot_spacing,
+                                        uint8_t response_slots);
+sl_status_t sl_bt_pawr_advertiser_set_subevent_data(uint8_t advertising_set,
+                                                    uint8_t subevent,
+                                                    uint8_t response_slot_start,
+                                                    uint8_t response_slot_count,
+                                                    size_t adv_data_len,
+                                                    const uint8_t* adv_data);
+
+sl_status_t sl_bt_extended_advertiser_set_data(uint8_t advertising_set,
+                                               size_t data_len,
+                                               const uint8_t* data);
+sl_status_t sl_bt_extended_advertiser_start(uint8_t advertising_set,
+                                            uint8_t connect,
+                                            uint32_t flags);
+
+// Scanner
+sl_status_t sl_bt_scanner_start(uint8_t scanning_phy, uint8_t discover_mode);
+sl_status_t sl_bt_scanner_stop(void);
+sl_status_t sl_bt_scanner_set_parameters(uint8_t mode, uint16_t interval, uint16_t window);
+
+// Connection
+sl_status_t sl_bt_connection_open(bd_addr address,
+                                  uint8_t address_type,
+                                  uint8_t initiating_phy,
+                                  uint8_t *connection);
+sl_status_t sl_bt_connection_close(uint8_t connection);
+
+// GATT client
+sl_status_t sl_bt_gatt_discover_primary_services(uint8_t connection);
+sl_status_t sl_bt_gatt_discover_primary_services_by_uuid(uint8_t connection,
+                                                         size_t uuid_len,
+                                                         const uint8_t* uuid);
+sl_status_t sl_bt_gatt_discover_characteristics(uint8_t connection,
+                                                uint32_t service);
+sl_status_t sl_bt_gatt_set_characteristic_notification(uint8_t connection,
+                                                       uint16_t characteristic,
+                                                       uint8_t flags);
+sl_status_t sl_bt_gatt_write_characteristic_value(uint8_t connection,
+                                                  uint16_t characteristic,
+                                                  size_t value_len,
+                                                  const uint8_t* value);
+
+// GATT server
+sl_status_t sl_bt_gatt_server_send_user_write_response(uint8_t connection,
+                                                       uint16_t characteristic,
+                                                       uint8_t att_errorcode);
+
+// PAST receiver and PAwR sync
+sl_status_t sl_bt_past_receiver_set_sync_receive_parameters(uint8_t connection,
+                                                            uint8_t mode,
+                                                            uint16_t skip,
+                                                            uint16_t timeout,
+                                                            uint8_t reporting_mode);
+sl_status_t sl_bt_sync_update_sync_parameters(uint16_t sync,
+                                              uint16_t skip,
+                                              uint16_t timeout);
+sl_status_t sl_bt_sync_close(uint16_t sync);
+sl_status_t sl_bt_sync_scanner_set_sync_parameters(uint16_t skip,
+                                                  uint16_t timeout,
+                                                  uint8_t reporting_mode);
+sl_status_t sl_bt_sync_scanner_open(bd_addr address,
+                                    uint8_t address_type,
+                                    uint8_t adv_sid,
+                                    uint16_t *sync);
+sl_status_t sl_bt_pawr_sync_set_sync_subevents(uint16_t sync,
+                                               size_t subevents_len,
+                                               const uint8_t* subevents);
+sl_status_t sl_bt_pawr_sync_set_response_data(uint16_t sync,
+                                              uint16_t request_event,
+                                              uint8_t request_subevent,
+                                              uint8_t response_subevent,
+                                              uint8_t response_slot,
+                                              size_t response_data_len,
+                                              const uint8_t* response_data);
+
+#endif /* SL_BLUETOOTH_H_ */
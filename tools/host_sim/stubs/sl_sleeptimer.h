@@ -0,0 +1,48 @@
+/*
+ * sl_sleeptimer.h
+ *
+ *  Host simulator stand-in for the sleeptimer service. Every simulated node
+ *  sees its own free running 32768 Hz tick counter derived from virtual time
+ *  and the crystal error configured for that node.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SL_SLEEPTIMER_H_
+#define SL_SLEEPTIMER_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+typedef struct sl_sleeptimer_timer_handle sl_sleeptimer_timer_handle_t;
+typedef void (*sl_sleeptimer_timer_callback_t)(sl_sleeptimer_timer_handle_t *handle, void *data);
+
+// One-shot timer, the callback runs at the expiry in the context of the node
+struct sl_sleeptimer_timer_handle {
+  sl_sleeptimer_timer_callback_t callback;
+  void     *callback_data;
+  bool     running;
+  uint64_t expiry_ns;
+};
+
+uint32_t sl_sleeptimer_get_tick_count(void);
+uint64_t sl_sleeptimer_get_tick_count64(void);
+uint32_t sl_sleeptimer_get_timer_frequency(void);
+sl_status_t sl_sleeptimer_ms32_to_tick(uint32_t time_ms, uint32_t *tick);
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick);
+sl_status_t sl_sleeptimer_start_timer(sl_sleeptimer_timer_handle_t *handle,
+                                      uint32_t timeout,
+                                      sl_sleeptimer_timer_callback_t callback,
+                                      void *callback_data,
+                                      uint8_t priority,
+                                      uint16_t option_flags);
+sl_status_t sl_sleeptimer_restart_timer(sl_sleeptimer_timer_handle_t *handle,
+                                        uint32_t timeout,
+                                        sl_sleeptimer_timer_callback_t callback,
+                                        void *callback_data,
+                                        uint8_t priority,
+                                        uint16_t option_flags);
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle);
+
+#endif /* SL_SLEEPTIMER_H_ */
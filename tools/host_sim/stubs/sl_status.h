@@ -0,0 +1,35 @@
+/*
+ * sl_status.h
+ *
+ *  Host simulator stand-in for the Gecko SDK status codes.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SL_STATUS_H_
+#define SL_STATUS_H_
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                    ((sl_status_t)0x0000)
+#define SL_STATUS_FAIL                  ((sl_status_t)0x0001)
+#define SL_STATUS_INVALID_STATE         ((sl_status_t)0x0002)
+#define SL_STATUS_NOT_READY             ((sl_status_t)0x0003)
+#define SL_STATUS_BUSY                  ((sl_status_t)0x0004)
+#define SL_STATUS_IN_PROGRESS           ((sl_status_t)0x0005)
+#define SL_STATUS_ABORT                 ((sl_status_t)0x0006)
+#define SL_STATUS_TIMEOUT               ((sl_status_t)0x0007)
+#define SL_STATUS_NOT_SUPPORTED         ((sl_status_t)0x000F)
+#define SL_STATUS_NOT_INITIALIZED       ((sl_status_t)0x0011)
+#define SL_STATUS_NO_MORE_RESOURCE      ((sl_status_t)0x0019)
+#define SL_STATUS_FULL                  ((sl_status_t)0x001A)
+#define SL_STATUS_EMPTY                 ((sl_status_t)0x001B)
+#define SL_STATUS_INVALID_PARAMETER     ((sl_status_t)0x0021)
+#define SL_STATUS_INVALID_RANGE         ((sl_status_t)0x0028)
+#define SL_STATUS_NOT_FOUND             ((sl_status_t)0x000D)
+#define SL_STATUS_INVALID_HANDLE        ((sl_status_t)0x0026)
+#define SL_STATUS_ALREADY_EXISTS        ((sl_status_t)0x002E)
+
+#endif /* SL_STATUS_H_ */
@@ -0,0 +1,16 @@
+/*
+ * sli_bt_gattdb_def.h
+ *
+ *  Host simulator stand-in for the GATT database definitions pulled in by
+ *  the generated gatt_db.h. Only the handle macros are used on the host.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: hdavid03
+ */
+
+#ifndef SLI_BT_GATTDB_DEF_H_
+#define SLI_BT_GATTDB_DEF_H_
+
+typedef struct sli_bt_gattdb_s sli_bt_gattdb_t;
+
+#endif /* SLI_BT_GATTDB_DEF_H_ */